@@ -1,1343 +1,6661 @@
-/*This is program is an IGuhit Language Interpreter. It interpretes the various*/
-/*IGuhit commands from an input text file and would save it to a bitmap file   */
-/*when directed.*/
-
-#include <stdio.h>
-#include <math.h>
-#include <string.h>
-#include <ctype.h>
-#include <stdlib.h>
-
-/*Constants in Interpreter*/
-
-#define POINT_MAX 100 /*Maximum number of points that can be created*/
-#define BOX_MAX 10 /*Maximum number of boxes that can be created*/
-#define CIRCLE_MAX 10 /*Maximum number of circles that can be created*/
-#define LINE_MAX 10 /*Maximum number of lines that can be created*/
-#define CHAR_MAX 1024 /*Maximum length of string*/
-#define PARAM_MAX 6 /*Maximum length of command*/
-#define PIXEL_MAX 200 /*Maximim number of pixels*/
-#define RADIUS_MAX 90 /*Maximum radius*/
-
-/*Error flags*/
-
-#define NO_ERROR 2
-#define ERR_CREATEFILE 3
-#define ERR_HEADER 4
-#define ERR_POINTMAX 5
-#define ERR_POINT 6
-#define ERR_LINEMAX 7
-#define ERR_LINE 8
-#define ERR_BOXMAX 9
-#define ERR_BOX 10
-#define ERR_BOXCORNER 11
-#define ERR_CIRCLEMAX 12
-#define ERR_RADIUSMAX 13
-#define ERR_CENTER 14
-#define ERR_MOVPT 15
-#define ERR_MOVSHAPE 16
-
-/*Structures for objects that can be created using IGuhit*/
-
-typedef struct {
-  int centerx;
-  int centery;
-  int radius;
-  int occupied;
-  char color;
-} circle, *circle_ptr;
-
-typedef struct {
-  int line1x;
-  int line1y;
-  int line2x;
-  int line2y;
-  int occupied;
-  char color;
-} line, *line_ptr;
-
-typedef struct {
-  int top_leftx;
-  int top_lefty;
-  int bot_rightx;
-  int bot_righty;
-  int occupied;
-  char color;
-} box, * box_ptr;
-
-typedef struct {
-  int x;
-  int y;
-  int occupied;
-  char color;
-} point, *point_ptr;
-
-typedef struct {
-  point pt[POINT_MAX];
-} pts, *pts_ptr;
-
-typedef struct {
-  line lines[LINE_MAX];
-} ln, *ln_ptr;
-
-typedef struct {
-  box boxes[BOX_MAX];
-} bx, *bx_ptr;
-
-typedef struct {
-  circle circles[CIRCLE_MAX];
-} cir, *cir_ptr;
-
-typedef struct {
-  float data[200];
-  char color;
-  int occupied;
-} graph, *graph_ptr;
-
-/*Function Prototypes*/
-
-int BMPheader (FILE *fp);
-int round_off (double entry);
-double compute_slope (int x1, int y1, int x2, int y2);
-int compute_diff(int, int);
-void clean_ws (char []);
-void rem_trail_ws (char []);
-void process_cmd (char [], char [][CHAR_MAX]);
-int process (char [][CHAR_MAX], pts_ptr ps, ln_ptr ls, bx_ptr bs, cir_ptr cs, graph_ptr g);
-void initialize_pts (pts_ptr ps);
-void initialize_ln (ln_ptr ls);
-void initialize_bx (bx_ptr bs);
-void initialize_cir (cir_ptr cs);
-void initialize_graph (graph_ptr g);
-int save_work (char [][CHAR_MAX], pts_ptr ps, ln_ptr ls, bx_ptr bs, cir_ptr cs, graph_ptr g);
-void print_error (int);
-int load_point (char [][CHAR_MAX], pts_ptr ps);
-int load_line (char [][CHAR_MAX], ln_ptr ls);
-int load_box (char [][CHAR_MAX], bx_ptr bs);
-int load_circle (char [][CHAR_MAX], cir_ptr cs);
-int load_graph (char [][CHAR_MAX], graph_ptr g);
-void delete_point (char [][CHAR_MAX], pts_ptr ps);
-void delete_line (char [][CHAR_MAX], ln_ptr ls);
-void delete_box (char [][CHAR_MAX], bx_ptr bs);
-void delete_circle (char[][CHAR_MAX], cir_ptr cs);
-int move_point (char [][CHAR_MAX], pts_ptr ps);
-int move_line (char [][CHAR_MAX], ln_ptr ls);
-int move_box (char [][CHAR_MAX], bx_ptr bs);
-int move_circle (char [][CHAR_MAX], cir_ptr cs);
-void create_graph (char [][PIXEL_MAX], graph_ptr g);
-void compute_midpt (int*, int*, int, int, int, int);
-void create_point (char [][PIXEL_MAX], pts_ptr ps);
-void create_line (char [][PIXEL_MAX], ln_ptr ls);
-void create_box (char [][PIXEL_MAX], bx_ptr bs);
-void create_circle (char [][PIXEL_MAX], cir_ptr cs);
-
-/*MAIN FUNCTION*/
-
-int main (int argc, char **argv)
-{
-  FILE *infile;
-  char string[CHAR_MAX], cmd[PARAM_MAX][CHAR_MAX];
-  int error = NO_ERROR, count, count2;
-  pts points;
-  ln lines;
-  bx boxes;
-  cir circles;
-  graph grap;
-
- 
-  initialize_pts (&points);
-  initialize_ln (&lines);
-  initialize_bx (&boxes);
-  initialize_cir (&circles);
-  initialize_graph (&grap);
-
-  if (argc < 2) 
-  {
-     printf ("ERROR: Input file not specified!\n");
-     return 1;
-  }
-
-  infile = fopen(argv[1], "r");
-  while (!feof(infile))
-  {
-    for (count = 0; count < CHAR_MAX; count++) string[count] = '\0';
-
-    for (count = 0; count < PARAM_MAX; count++)
-      {
-	for (count2 = 0; count2 < CHAR_MAX; count2++)
-	  {
-	    cmd[count][count2] = '\0';
-	  }
-      }
-     fgets(string, CHAR_MAX, infile);
-     clean_ws(string);
-     rem_trail_ws (string);
-     if (strlen(string) != 0)
-       {
-	 process_cmd (string, cmd);
-	 error = process (cmd, &points, &lines, &boxes, &circles, &grap);
-	 if (error != NO_ERROR)
-	   {
-	     print_error(error);
-	     fclose(infile);
-	     return 1;
-	   }
-       }
-  }
-  fclose (infile);
-  return 0;
-}
-
-/*The following functions initialize the subjects that will contain*/
-/*that are going to be created in Iguhit*/ 
-
-void initialize_pts (pts_ptr ps)
-{
-  memset(ps, 0, POINT_MAX * sizeof(point));
-}
-
-void initialize_ln (ln_ptr ls)
-{
-  memset(ls, 0, LINE_MAX * sizeof(line));
-}
-
-void initialize_bx (bx_ptr bs)
-{
-  memset(bs, 0, BOX_MAX * sizeof(box));
-}
-
-void initialize_cir (cir_ptr cs)
-{
-  memset(cs, 0, CIRCLE_MAX * sizeof(circle));
-}
-
-void initialize_graph (graph_ptr g)
-{
-  memset(g->data, 0, PIXEL_MAX * sizeof(float));
-  g->color = 0;
-  g->occupied = 0;
-}
-
-/*clean_ws removes any leading whitespace in string after using fgets*/
-
-void clean_ws(char string[])
-{
-  char temp[1024];
-  int count, count2;
-
-  count2 = 0;
-  for (count = 0; count < strlen(string); count++)
-  {
-    if (!isspace(string[count])) break;
-  }
-
-  for (; count < strlen(string); count++)
-  {
-	  temp[count2] = string[count];
-	  count2++;
-	  temp[count2] = '\0';
-  }
-  strcpy(string, temp);
-}
-
-/*rem_trail_ws removes any trailing whitespace like \n at end of string after*/
-/*using fgets*/
-
-void rem_trail_ws (char line [])
-{
-  char c;
-  int j = strlen(line)-1;
-  int count;
-
-  if (strcmp(line, "\n") == 0) line[0] = '\0';
-  else {
-    for (count = j; count >= 0; count--)
-      {
-	if (!isspace(line[count]))
-	  {
-	    count++;
-	    line[count] = '\0';
-	    break;
-	  }
-      }
-  }
-}
-
-/*process analyzes command line and calls on the function for the corresponding*/
-/*command*/
-
-int process (char cmd[][CHAR_MAX], pts_ptr ps, ln_ptr ls, bx_ptr bs, cir_ptr cs, graph_ptr g)
-{
-  int error = NO_ERROR;
-
-  switch (cmd[0][0])
-    {
-    case 'P':
-      error = load_point (cmd, ps);
-      break;
-     
-    case 'L':
-      error = load_line (cmd, ls);
-      break;
-    
-    case 'B':
-      error = load_box (cmd, bs);
-      break;
- 
-    case 'C':
-      error = load_circle (cmd, cs);
-      break;
-    }
-  
-  if (strcmp(cmd[0], "MOVE") == 0)
-    {
-      switch (cmd[1][0])
-        {
-	case 'P':
-	  error = move_point (cmd, ps);
-	  break;
-     
-	case 'L':
-	  error = move_line (cmd, ls);
-	  break;
-    
-	case 'B':
-	  error = move_box (cmd, bs);
-	  break;
- 
-	case 'C':
-	  error = move_circle (cmd, cs);
-	  break;
-        }
-
-    }
-
-  if (strcmp(cmd[0], "DELT") == 0)
-    {
-      switch (cmd[1][0])
-        {
-	case 'P':
-	  delete_point (cmd, ps);
-	  break;
-     
-	case 'L':
-	  delete_line (cmd, ls);
-	  break;
-    
-	case 'B':
-	  delete_box (cmd, bs);
-	  break;
- 
-	case 'C':
-	  delete_circle (cmd, cs);
-	  break;
-        }
-    }
-  
-  if (strcmp(cmd[0], "GRAP") == 0) error = load_graph(cmd, g);
-
-  if (strcmp(cmd[0], "SAVE") == 0) error = save_work(cmd, ps, ls, bs, cs, g);
-  
-  return error;  
-}
-
-/*process_cmd divides string obtained in input file into words for easy reading*/
-/*places them to a two dimensional char array*/ 
-
-void process_cmd (char string[], char cmd[][CHAR_MAX])
-{
-
-  char *marker, *marker2;
-  int count, count2;
-
-  marker = string;
-  marker2 = strchr(string, ' ');
-
-  count = 0;
-  while (*marker != *marker2)
-    {
-      cmd[0][count] = *marker;
-      count++;
-      cmd[0][count] = '\0';
-      marker++;
-    }
-
-  marker2 = strchr(marker, ',');
-  if (marker2 == NULL)
-    {
-      marker++;
-      count = 0;
-      while (*marker != '\0')
-	{
-	  cmd[1][count] = *marker;
-	  count++;
-	  cmd[1][count] = '\0';
-	  marker++;
-	}
-      clean_ws(cmd[1]);
-    }
-  else {
-   
-    count2 = 1;
-    while ((*marker != '\0') && (count2 != PARAM_MAX))
-      {
-	marker++;
-	marker2 = strchr(marker, ',');
-	count = 0;
-	if (marker2 != NULL)
-	  {	  
-	    while (*marker != *marker2)
-	      {
-		cmd[count2][count] = *marker;
-		count++;
-		cmd[count2][count] = '\0';
-		marker++;
-	      }
-	  }
-	else {
-	  while (*marker != '\0')
-	    {
-	      cmd[count2][count] = *marker;
-	      count++;
-	      cmd[count2][count] = '\0';
-	      marker++;
-	    }
-	}	  
-	clean_ws(cmd[count2]);
-	count2++;
-      }
-  }
-}
-
-/*load_point load information for a point to its structure and returns any*/
-/*error flag if there is an error*/
-
-int load_point (char cmd[][CHAR_MAX], pts_ptr ps)
-{
-  char *number;
-  int pnum, colnum, pointx, pointy;
-
-  number = cmd[0];
-  number++;
-  pnum = atoi(number) - 1;
-  if ((pnum > -1) && (pnum < POINT_MAX))
-    {
-      pointx = atoi(cmd[1]);
-      pointy = atoi(cmd[2]);
-      if ((pointx < 1) || (pointy < 1) || (pointx > PIXEL_MAX) || (pointy > PIXEL_MAX)) 
-	{
-	  return ERR_POINT;
-	}
-      else
-	{
-	  ps->pt[pnum].x = atoi(cmd[1]);
-	  ps->pt[pnum].y = atoi(cmd[2]);
-	  ps->pt[pnum].occupied = 1;
-	}
-      colnum = atoi(cmd[3]);
-      if ((colnum < 0) || (colnum > 4)) ps->pt[pnum].color = 1;
-      else ps->pt[pnum].color = colnum;
-      return NO_ERROR;
-    }
-  else return ERR_POINTMAX;
-} 
-
-/*load_line loads information for a line to its structure and returns an error */
-/*flag if an error has occured*/
-
-int load_line (char cmd[][CHAR_MAX], ln_ptr ls)
-{
-  int lnum, colnum, x1, x2, y1, y2;
-  char *number;
-
-  number = cmd[0];
-  number++;
-  lnum = atoi(number) - 1;
-
-  if ((lnum > -1) && (lnum < LINE_MAX))
-    {
-      x1 = atoi(cmd[1]);
-      y1 = atoi(cmd[2]);
-      x2 = atoi(cmd[3]);
-      y2 = atoi(cmd[4]);
-
-      if ((x1 < 1) || (x2 < 1) || (x1 > PIXEL_MAX) || (x2 > PIXEL_MAX) || (y1 < 1) || (y2 < 1) || (y1 > PIXEL_MAX) || (y2 > PIXEL_MAX))
-	{
-	  return ERR_LINE;
-	}
-      else {
-	ls->lines[lnum].line1x = x1;
-	ls->lines[lnum].line1y = y1;
-	ls->lines[lnum].line2x = x2;
-	ls->lines[lnum].line2y = y2;
-	ls->lines[lnum].occupied = 1;
-	
-      }
-
-      colnum = atoi(cmd[5]);
-      if ((colnum < 0) || (colnum > 4)) ls->lines[lnum].color = 1;
-      else ls->lines[lnum].color = colnum;
-      return NO_ERROR;
-    }
-
-  else return ERR_LINEMAX;      
-}
-
-/*load_box loads information for a box to its structure and returns an error */
-/*flag if an error has occured*/
-
-int load_box (char cmd[][CHAR_MAX], bx_ptr bs)
-{
-  int bnum, colnum, x1, y1, x2, y2;
-  char *number;
-
-  number = cmd[0];
-  number++;
-  bnum = atoi(number) - 1;
-
-  if ((bnum > -1) && (bnum < BOX_MAX))
-    {
-      x1 = atoi(cmd[1]);
-      y1 = atoi(cmd[2]);
-      x2 = atoi(cmd[3]);
-      y2 = atoi(cmd[4]);
-      if ((x1 < 1) || (x2 < 1) || (x1 > PIXEL_MAX) || (x2 > PIXEL_MAX) || (y1 < 1) || (y2 < 1) || (y1 > PIXEL_MAX) || (y2 > PIXEL_MAX))
-	{
-	  return ERR_BOX;
-	}
-      else {
-	if ((x2 < x1) || (y2 > y1)) return ERR_BOXCORNER;
-	else {
-	  bs->boxes[bnum].top_leftx = x1;
-	  bs->boxes[bnum].top_lefty = y1;
-	  bs->boxes[bnum].bot_rightx = x2;
-	  bs->boxes[bnum].bot_righty = y2;
-	  bs->boxes[bnum].occupied = 1;
-	}
-      }
-      colnum = atoi(cmd[5]);
-      if ((colnum < 0) || (colnum > 4)) bs->boxes[bnum].color = 1;
-      else bs->boxes[bnum].color = colnum;
-      return NO_ERROR;
-    }
-
-  else return ERR_BOXMAX;
-}
-
-/*load_circle loads information for a circle to its structure and returns an error*/
-/*flag if an error has occured*/
-
-int load_circle (char cmd[][CHAR_MAX], cir_ptr cs)
-{
-  int cnum, colnum, x, y, rad;
-  char *number;
-
-  number = cmd[0];
-  number++;
-  cnum = atoi(number) - 1;
-
-  if ((cnum > -1) && (cnum < CIRCLE_MAX))
-    {
-      x = atoi(cmd[1]);
-      y = atoi(cmd[2]);
-      if ((x < 1) || (y < 1) || (x > PIXEL_MAX) || (y > PIXEL_MAX))
-	{
-	  return ERR_CENTER;
-	}
-      else {
-	rad = atoi(cmd[3]);
-	if ((rad < 0) || (rad > 89)) return ERR_RADIUSMAX;
-	else {
-	  cs->circles[cnum].centerx = x;
-	  cs->circles[cnum].centery = y;
-	  cs->circles[cnum].radius = rad;
-	  cs->circles[cnum].occupied = 1;
-	}
-	colnum = atoi(cmd[4]);
-	if ((colnum < 0) || (colnum > 4)) cs->circles[cnum].color = 1;
-	else cs->circles[cnum].color = colnum;
-	return NO_ERROR;
-      }
-    }
-
-  else return ERR_CIRCLEMAX;
-}
-
-/*load_graph loads information for a graph to its structure and returns an error */
-/*flag if an error has occured*/
-
-int load_graph (char cmd[][CHAR_MAX], graph_ptr g)
-{
-  FILE *infile;
-  int colnum;
-
-  infile = fopen(cmd[1], "rb");
-  fread(g->data, sizeof(float), PIXEL_MAX, infile);
-  colnum = atoi(cmd[2]);
-  if ((colnum < 0) || (colnum > 4)) g->color = 1;
-  else g->color = colnum;
-  g->occupied = 1;
-  return NO_ERROR;
-}
-
-/*print_error prints out the specific error brought by the error flag*/
-
-void print_error (int error)
-{
-  switch (error)
-    {
-    case ERR_CREATEFILE:
-      printf ("ERROR: Output File can't be created.\n");
-      break;
-
-    case ERR_HEADER:
-      printf ("ERROR: Can't create bitmap header.\n");
-      break;
-
-    case ERR_POINTMAX:
-      printf ("ERROR: Invalid Point Number.\n");
-      break;
-
-    case ERR_POINT:
-      printf ("ERROR: Point not within canvas.\n");
-      break;
-
-    case ERR_LINEMAX:
-      printf ("ERROR: Invalid Line Number.\n");
-      break;
-
-    case ERR_LINE:
-      printf ("ERROR: Endpoint(s) of line not within canvas.\n");
-      break;
-
-    case ERR_BOXMAX:
-      printf ("ERROR: Invalid Box Number.\n");
-      break;
-
-    case ERR_BOX:
-      printf ("ERROR: Top left corner and/or bottom right corner of box not within canvas.\n");
-      break;
-
-    case ERR_BOXCORNER:
-      printf ("ERROR: Invalid corner(s).\n");
-      break;
-
-    case ERR_CIRCLEMAX:
-      printf ("ERROR: Invalid Circle Number.\n");
-      break;
-
-    case ERR_RADIUSMAX:
-      printf ("ERROR: Invalid Circle Radius.\n");
-      break;
-
-    case ERR_CENTER:
-      printf ("ERROR: Center of Circle not within canvas.\n");
-      break;
-
-    case ERR_MOVPT:
-      printf ("ERROR: Center of Shape not within canvas.\n");
-      break;
-
-    case ERR_MOVSHAPE:
-      printf ("ERROR: Some points of shape not within canvas.\n");
-      break;
-    }
-}
-
-/*delete_point deletes the point by deactivating the occupied flag*/
-
-void delete_point (char cmd [][CHAR_MAX], pts_ptr ps)
-{
-  char *number;
-  int pnum;
-
-  number = cmd[1];
-  number++;
-  pnum = atoi(number) - 1;
-
-  if ((pnum > -1) && (pnum < POINT_MAX))
-    {
-      if (ps->pt[pnum].occupied) ps->pt[pnum].occupied = 0;
-    }
-}
-
-/*delete_line deletes the line by deactivating the occupied flag*/
-
-void delete_line (char cmd [][CHAR_MAX], ln_ptr ls)
-{
-  char *number;
-  int lnum;
-
-  number = cmd[1];
-  number++;
-  lnum = atoi(number) - 1;
-
-  if ((lnum > -1) && (lnum < LINE_MAX))
-    {
-      if (ls->lines[lnum].occupied) ls->lines[lnum].occupied = 0;
-    }
-}
-
-/*delete_box deletes the box by deactivating the occupied flag*/
-
-void delete_box (char cmd [][CHAR_MAX], bx_ptr bs)
-{
-  char *number;
-  int bnum;
-
-  number = cmd[1];
-  number++;
-  bnum = atoi(number) - 1;
-
-  if ((bnum > -1) && (bnum < BOX_MAX))
-    {
-      if (bs->boxes[bnum].occupied) bs->boxes[bnum].occupied = 0;
-    }
-}
-
-/*delete_circle deletes the circle by deactivating the occupied flag*/
-
-void delete_circle (char cmd [][CHAR_MAX], cir_ptr cs)
-{
-  char *number;
-  int cnum;
-
-  number = cmd[1];
-  number++;
-  cnum = atoi(number) - 1;
-
-  if ((cnum > -1) && (cnum < CIRCLE_MAX))
-    {
-      if (cs->circles[cnum].occupied) cs->circles[cnum].occupied = 0;
-    }
-}
-
-/*move_point moves point by changing the coordinates of the point to the */
-/*coordinates found in the command*/
-
-int move_point (char cmd[][CHAR_MAX], pts_ptr ps)
-{
-  char *number;
-  int pnum, colnum, x, y;
-
-  number = cmd[1];
-  number++;
-  pnum = atoi(number) - 1;
-
-  if ((pnum > -1) && (pnum < POINT_MAX))
-    {
-      if (ps->pt[pnum].occupied)
-	{
-	  x = atoi(cmd[2]);
-	  y = atoi(cmd[3]);
-	  if ((x < 1) || (y < 1) || (x > PIXEL_MAX) || (y > PIXEL_MAX))
-	    {
-	      return ERR_MOVPT;
-	    }
-	  else {
-	    ps->pt[pnum].x = x;
-	    ps->pt[pnum].y = y;
-	    colnum = atoi(cmd[4]);
-	    if ((colnum < 0) || (colnum > 4)) ps->pt[pnum].color = 1;
-	    else ps->pt[pnum].color = colnum;
-	  }
-	}
-    } 
-  return NO_ERROR;
-} 
-
-/*move_line moves a line by computing the difference of the center of the line and*/
-/*the point indicated by the command and by adding this difference to the */
-/*coordinate information of the line*/
-
-int move_line (char cmd[][CHAR_MAX], ln_ptr ls)
-{
-  char *number;
-  int lnum, colnum, x1, x2, y1, y2, diffx, diffy, cenx, ceny, ncenx, nceny;
-
-  number = cmd[1];
-  number++;
-  lnum = atoi(number) - 1;
-
-  if ((lnum > -1) && (lnum < LINE_MAX))
-  {
-     if (ls->lines[lnum].occupied)
-     {
-        compute_midpt(&cenx, &ceny, ls->lines[lnum].line1x, ls->lines[lnum].line1y, ls->lines[lnum].line2x, ls->lines[lnum].line2y);
-        ncenx = atoi(cmd[2]);
-        nceny = atoi(cmd[3]);
-
-        if ((ncenx < 1) || (nceny < 1) || (ncenx > PIXEL_MAX) || (nceny > PIXEL_MAX))
-        {
-           return ERR_MOVPT;
-        }
-        else {
-          diffx = ncenx - cenx;
-          diffy = nceny - ceny;
-        
-          x1 = ls->lines[lnum].line1x + diffx;
-          x2 = ls->lines[lnum].line2x + diffx;
-          y1 = ls->lines[lnum].line1y + diffy;
-          y2 = ls->lines[lnum].line2y + diffy;
- 
-          if ((x1 < 1) || (y1 < 1) || (x2 < 1) || (y2 < 1) || (x1 > PIXEL_MAX) || (y1 > PIXEL_MAX) || (x2 > PIXEL_MAX) || (y2 > PIXEL_MAX))
-          {
-             return ERR_MOVSHAPE;
-          }
-          else {
-            ls->lines[lnum].line1x = x1;
-            ls->lines[lnum].line2x = x2;
-            ls->lines[lnum].line1y = y1;
-            ls->lines[lnum].line2y = y2;
-            colnum = atoi(cmd[4]);
-            if ((colnum < 0) || (colnum > 4)) ls->lines[lnum].color = 1;
-            else ls->lines[lnum].color = colnum;
-          }
-        }
-     }
-  }
-  return NO_ERROR;
-}
-
-/*move_box moves a line by computing the difference of the center of the box and*/
-/*the point indicated by the command and by adding this difference to the */
-/*coordinate information of the box*/
-
-int move_box (char cmd[][CHAR_MAX], bx_ptr bs)
-{
-  char *number;
-  int bnum, colnum, x1, x2, y1, y2, diffx, diffy, cenx, ceny, ncenx, nceny;
-
-  number = cmd[1];
-  number++;
-  bnum = atoi(number) - 1;
-
-  if ((bnum > -1) && (bnum < BOX_MAX))
-  {
-     if (bs->boxes[bnum].occupied)
-     {
-        compute_midpt(&cenx, &ceny, bs->boxes[bnum].top_leftx, bs->boxes[bnum].top_lefty, bs->boxes[bnum].bot_rightx, bs->boxes[bnum].bot_righty);
-        ncenx = atoi(cmd[2]);
-        nceny = atoi(cmd[3]);
-
-        if ((ncenx < 1) || (nceny < 1) || (ncenx > PIXEL_MAX) || (nceny > PIXEL_MAX))
-        {
-           return ERR_MOVPT;
-        }
-        else {
-          diffx = ncenx - cenx;
-          diffy = nceny - ceny;
-        
-          x1 = bs->boxes[bnum].top_leftx + diffx;
-          x2 = bs->boxes[bnum].bot_rightx + diffx;
-          y1 = bs->boxes[bnum].top_lefty + diffy;
-          y2 = bs->boxes[bnum].bot_righty + diffy;
- 
-          if ((x1 < 1) || (y1 < 1) || (x2 < 1) || (y2 < 1) || (x1 > PIXEL_MAX) || (y1 > PIXEL_MAX) || (x2 > PIXEL_MAX) || (y2 > PIXEL_MAX))
-          {
-             return ERR_MOVSHAPE;
-          }
-          else {
-            bs->boxes[bnum].top_leftx = x1;
-            bs->boxes[bnum].bot_rightx = x2;
-            bs->boxes[bnum].top_lefty = y1;
-            bs->boxes[bnum].bot_righty = y2;
-
-            colnum = atoi(cmd[4]);
-            if ((colnum < 0) || (colnum > 4)) bs->boxes[bnum].color = 1;
-            else bs->boxes[bnum].color = colnum;
-          }
-        }
-     }
-  }
-  return NO_ERROR;
-}
-
-/*move_circle moves point by changing the center of the point to the */
-/*coordinates found in the command*/
-
-int move_circle (char cmd[][CHAR_MAX], cir_ptr cs)
-{
-  char *number;
-  int cnum, colnum, cenx, ceny;
-
-  number = cmd[1];
-  number++;
-  cnum = atoi(number) - 1;
-
-  if ((cnum > -1) && (cnum < CIRCLE_MAX))
-    {
-      if (cs->circles[cnum].occupied)
-	{
-	  cenx = atoi(cmd[2]);
-	  ceny = atoi(cmd[3]);
-	  if ((cenx < 1) || (ceny < 1) || (cenx > PIXEL_MAX) || (ceny > PIXEL_MAX))
-	    {
-	      return ERR_MOVPT;
-	    }
-	  else {
-	    cs->circles[cnum].centerx = cenx;
-	    cs->circles[cnum].centery = ceny;
-	    colnum = atoi(cmd[4]);
-	    if ((colnum < 0) || (colnum > 4)) cs->circles[cnum].color = 1;
-	    else cs->circles[cnum].color = colnum;
-	  }
-	}
-    } 
-  return NO_ERROR;
-}
-
-/*save_work saves the objects created by creating and then writing info to the*/
-/*bitmap file*/
-
-int save_work (char cmd[][CHAR_MAX], pts_ptr ps, ln_ptr ls, bx_ptr bs, cir_ptr cs, graph_ptr g)
-{
-  FILE *fp;
-  int loop, loop2, count, count2, x, y;
-  char pixel, display[200][200];
-  
-  fp = fopen (cmd[1], "wb");
-
-  if (fp == NULL) return ERR_CREATEFILE;
-
-  if (BMPheader(fp)) return ERR_HEADER;
-
-  for (loop = 0; loop < 200; loop++)
-    {
-      for (loop2 = 0; loop2 < 200; loop2++)
-	{
-	  display[loop][loop2] = 0;
-	}
-    }
-
-  create_point (display, ps);
-  create_line (display, ls);
-  create_box (display, bs);
-  create_circle (display, cs);
-  create_graph (display, g);
-
-
-  for (loop = 0; loop < 200; loop++)
-    {
-      for (loop2 = 0; loop2 < 200; loop2++)
-	{
-	  pixel = display[loop][loop2];
-	  fwrite (&pixel, 1, 1, fp);
-	}
-    }
-
-  fclose (fp);
-
-  return NO_ERROR;
-}
-
-/*compute_midpt computes the mid point of two points*/
-
-void compute_midpt (int *centerx, int *centery, int x1, int y1, int x2, int y2)
-{
-  double diffx, diffy, cenx, ceny;
-
-  if (x1 < x2) diffx = (double) ((x2 - x1)/2.0);
-  else diffx = (double) ((x1 - x2)/2.0);
-
-  if (y1 < y2) diffy = (double) ((y2 - y1)/2.0);
-  else diffy = (double) ((y1 - y2)/2.0);
-
-  if (x1 < x2) cenx = (((double)(x1)) + diffx);
-  else cenx = (((double)(x2)) + diffx);
-
-  if (y1 < y2) ceny = (((double)(y1)) + diffy);
-  else ceny = (((double)(y2)) + diffy);
-
-  *centerx = round_off(cenx);
-  *centery = round_off(ceny);
-}
-
-/*round_off rounds off a decimal to an integer*/
-
-int round_off (double entry)
-{
-  char buf[128];
-  char* marker;
-  int flag, result;
-
-  sprintf(buf, "%.1f", entry);
-  /* locate the decimal point */
-  marker = strchr(buf, '.');
-  if (marker == NULL)
-    {
-      printf("Error in roundoff function!\n");
-      exit(1);
-    }
-  
-  if (entry >= 0)
-    {
-      if ((*(marker+1)-'0') > ('4' - '0'))
-	{
-	  flag = 1;  /*means we need to add 1*/
-	}
-      else
-	{
-	  flag=0;
-	}
-      *(marker + 1) = '\0';
-      sscanf(buf, "%d", &result);
-      if (flag)
-	{
-	  result += 1;
-	}
-    }
-
-  else 
-    {
-      if ((*(marker+1)-'0') > ('4' - '0'))
-	{
-	  flag = 1;  /*means we need to add -1*/
-	}
-      else
-	{
-	  flag=0;
-	}
-      *(marker + 1) = '\0';
-      sscanf(buf, "%d", &result);
-      if (flag)
-	{
-	  result += -1;
-	}
-    }
-
-  return result;
-}
-
-/*compute_slope computes the slope of a line*/
-
-double compute_slope (int x1, int y1, int x2, int y2)
-{
-  double res, xc, yc;
-
-  xc = (double) (x1 - x2);
-  yc = (double) (y1 - y2);
-  res = yc / xc;
-  return res;
-}
-
-/*create_point creates point by placing values to char array*/
-
-void create_point (char display [][PIXEL_MAX], pts_ptr ps)
-{
-  int index;
-
-  for (index = 0; index < POINT_MAX; index++)
-    {
-      if (ps->pt[index].occupied) display [ps->pt[index].y-1][ps->pt[index].x-1] = ps->pt[index].color;
-    }
-}
-
-/*create_line creates point by placing values to char array*/
-
-void create_line (char display [][PIXEL_MAX], ln_ptr ls)
-{
-  int x1, x2, y1, y2, xa, ya, xb, yb, count, x, y, diffx, diffy, index;
-  double countd, slope, xd, yd, part;
-
-  for (index = 0; index < LINE_MAX; index++)
-    {
-     if (ls->lines[index].occupied)
-       {
-	 xa = ls->lines[index].line1x-1;
-	 ya = ls->lines[index].line1y-1;
-	 xb = ls->lines[index].line2x-1;
-	 yb = ls->lines[index].line2y-1;
-
-	 /*Vertical Line*/
-	 if (xa == xb)
-	   {
-	     if (ya > yb)
-	       {
-		 x1 = xb;
-		 x2 = xa;
-		 y1 = yb;
-		 y2 = ya;
-	       }
-	     else {
-      	
-	       x1 = xa;
-	       x2 = xb;
-	       y1 = ya;
-	       y2 = yb;
-	     }
-          
-	     for (count = y1; count <= y2; count++) display[count][x1] = ls->lines[index].color;
-	   }
-	 else {
-         
-	   /*Horizontal Line*/
-           if (ya == yb)
-	     {
-	       if (xa > xb)
-		 {
-	           x1 = xb;
-	           x2 = xa;
- 	           y1 = yb;
-   	           y2 = ya;
-		 }
-	       else {
-	        
-		 x1 = xa;
-		 x2 = xb;
-		 y1 = ya;
-		 y2 = yb;
-	       }
-          
-	       for (count = x1; count <= x2; count++) display[y1][count] = ls->lines[index].color;
-	     }
-           else {
-	     
-	     /*Line with steep slope*/
-	     slope = compute_slope(xa, ya, xb, yb);
-	     if ((slope > 1) || (slope < -1))
-	       {
-		 if (xa > xb)
-		   {
-		     x1 = xb;
-		     x2 = xa;
-		     y1 = yb;
-		     y2 = ya;
-		   }
-		 else {
-		   x1 = xa;
-		   x2 = xb;
-		   y1 = ya;
-		   y2 = yb;
-		 }
-		 diffx = x2 - x1;
-		 diffy = compute_diff(y1, y2) + 1;
-		 part = ((double) diffx) / ((double) diffy);
-	      
-		 for (count = 0; count <= diffy; count++)
-		   {
-		     countd = (double) count;
-		     xd = (countd * part) + x1;
-		     yd = (slope * (xd - x1)) + y1;
-		     x = round_off(xd);
-		     y = round_off(yd);
-		     display[y][x] = ls->lines[index].color;
-		   }
-	       }
-	     else {
-	    
-	       /*Line with flat or regular slope*/
-	       if ((slope <= 1) && (slope >= -1))
-		 {
-		   if (xa > xb)
-		     {
-		       x1 = xb;
-		       x2 = xa;
-		       y1 = yb;
-		       y2 = ya;
-		     }
-		   else {
-		     x1 = xa;
-		     x2 = xb;
-		     y1 = ya;
-		     y2 = yb;
-		   }
-		   for (count = x1; count <= x2; count++)
-		     {
-		       xd = (double) count;
-		       yd = (slope * (xd - x1)) + y1;
-		       x = round_off(xd);
-		       y = round_off(yd);
-		       display[y][x] = ls->lines[index].color;
-		     }
-		 }
-	     }
-	   }
-	 }
-       }
-    }
-}
-
-/*create_box creates box by placing values to char array*/
-
-void create_box (char display [][PIXEL_MAX], bx_ptr bs)
-{
-  int index, count, count2;
-
-  for (index = 0; index < BOX_MAX; index++)
-    {
-      if (bs->boxes[index].occupied)
-	{
-	  for (count = (bs->boxes[index].bot_righty - 1); count < bs->boxes[index].top_lefty; count++)
-	    {
-	      for (count2 = (bs->boxes[index].top_leftx - 1); count2 < bs->boxes[index].bot_rightx;count2++) 
-		{
-		  display[count][count2] = bs->boxes[index].color;
-		}
-	    } 
-	}
-    }
-}
-
-/*create_circle creates circle by placing values to char array*/
-
-void create_circle (char display [][200], cir_ptr cs)
-{
-  int index, count, count2, x, y, cenx, ceny, ptx, pty;
-  double rad, par;
-
-  for (index = 0; index < CIRCLE_MAX; index++)
-    {
-      if (cs->circles[index].occupied)
-	{
-	  cenx = cs->circles[index].centerx - 1;
-	  ceny = cs->circles[index].centery - 1;
-	  for (count = 0; count < 360; count++)
-	    {
-	      rad = acos(-1);
-	      par = (double) (count);
-	      par = par / 180.0;
-	      rad = rad * par;
-	      for (count2 = 0; count2 <= cs->circles[index].radius; count2++)
-		{
-		  x =  round_off(count2 * (cos(rad)));
-		  y =  round_off(count2 * (sin(rad)));
-		  ptx = cenx + x;
-		  pty = ceny + y;
-		  if ((ptx >= 0) && (pty >= 0) && (ptx < PIXEL_MAX) && (pty < PIXEL_MAX))
-		    {
-		      if ((count2 != cs->circles[index].radius) && (ptx != 0) && (ptx != 199) && (pty != 0) && (pty != 199))
-			{ 
-			  display[pty][ptx+1] = cs->circles[index].color;
-			  display[pty][ptx-1] = cs->circles[index].color;
-			  display[pty+1][ptx] = cs->circles[index].color;
-			  display[pty-1][ptx] = cs->circles[index].color;
-			}
-		      display[pty][ptx] = cs->circles[index].color;
-		    }
-		}
-	    }
-	}
-    }
-}
-
-/*create_graph creates graph by placing values to char array*/
-
-void create_graph (char display[][PIXEL_MAX], graph_ptr g)
-{
-  int count, count2, count3, count4, y;
-  float mark, diff, half, min, max;
-
-  if (g->occupied)
-    {
-      /*create the grid lines*/
-      for (count4 = 0; count4 < PIXEL_MAX; count4++)
-	{
-	  display[99][count4] = 1;
-	  display[count4][99] = 1;
-	}
-      for (count = 0; count < PIXEL_MAX; count++)
-	{
-	  mark = g->data[count];
-	  mark = (mark + 1) * 100;
-	  y = round_off((double)mark);
-	  if (y > 0)
-	    {
-	      display[y-1][count] = g->color;
-	    }
-	  else display[0][count] = g->color;
-	}
-    }
-}
-
-/*compute_diff computes the difference (absolute value) of 2 numbers*/
-
-int compute_diff (int a, int b)
-{
-  if (a > b) return (a-b);
-  else return (b-a);
-}
-
-/*BMPheader function*/
-
-int BMPheader (FILE *fp)
-{
-  unsigned short int sDummy;
-  unsigned long int lDummy;
-  unsigned int loop;
-
-  /*Check if sizes are correct*/
-
-  if (sizeof(sDummy) != 2) printf("Dsfds\n");
-  if (sizeof(lDummy) != 4) printf("dsfadsf\n");
-
-  fputc ('B', fp);              /* BITMAP ID */
-  fputc('M', fp);
-
-  lDummy = 41078;               /* File Size */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0;                   /* Reserved */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 1078;                /* Bitmap Data Offset */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0x28;                /* Bitmap Header Size */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 200;                 /* Horizontal Width */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 200;                 /* Veritcal Height */
-  fwrite (&lDummy, 4, 1, fp);
-
-  sDummy = 1;                   /* Number of Planes */
-  fwrite (&sDummy, 2, 1, fp);
-
-  sDummy = 8;                   /* Bits Per Pixel */
-  fwrite (&sDummy, 2, 1, fp);
-
-  lDummy = 0;                   /* Compression */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 40000;               /* Bitmap Data Size */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0;                   /* Horizontal Resolution */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0;                   /* Vertical Resolution */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 256;                 /* Number of Colors */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0;                   /* Number of Important Colors */
-  fwrite (&lDummy, 4, 1, fp);
-
-  /* Palette */
-
-  lDummy = 0x00FFFFFF;          /* WHITE */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0x00000000;          /* BLACK */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0x00FF0000;          /* RED */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0x0000FF00;          /* GREEN */
-  fwrite (&lDummy, 4, 1, fp);
-
-  lDummy = 0x000000FF;          /* BLUE */
-  fwrite (&lDummy, 4, 1, fp);
-
-  for (loop = 0; loop < 251; loop++)
-    {
-      lDummy = 0;
-      fwrite (&lDummy, 4, 1, fp);
-    }
-
-  return 0;
-}
+/*This is program is an IGuhit Language Interpreter. It interpretes the various*/
+/*IGuhit commands from an input text file and would save it to a bitmap file   */
+/*when directed.*/
+
+/*The first declares pwrite, mkstemp and the other POSIX.1-2008 calls used*/
+/*below, the second madvise and its advice, also under -std=c99*/
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <signal.h>
+#include "idraw.h"
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPAN_SIMD 1
+#endif
+
+/*Constants in Interpreter*/
+
+#define POOL_INITIAL 16 /*Initial number of slots in a shape pool*/
+#define POOL_FIELDS 4 /*Maximum number of coordinates of a shape*/
+#define PARAM_MAX 6 /*Maximum number of words in a command*/
+#define PIXEL_MAX 200 /*Default width and height of the canvas in pixels*/
+#define RADIUS_MAX 90 /*Maximum radius on the default canvas*/
+#define CANVAS_MAX 32768 /*Maximum width or height of the canvas*/
+#define BMP_HEADER 1078 /*Size of the bitmap headers and palette*/
+#define TILE_SIZE 256 /*Width and height of the tiles drawn in parallel*/
+#define BIN_MAX 67108864 /*Most tile entries binned before drawing serially instead*/
+#define GRID_CELL 64 /*Width and height of a cell of the shape grids*/
+#define GRID_LARGE 1024 /*Shapes over more cells than this are kept in one list instead*/
+#define DIRTY_MAX 32 /*Regions changed between SAVEs kept apart before they are merged*/
+#define RLE_BLOCK 262144 /*Bytes of run-length encoded rows written at a time*/
+#define PNG_BLOCK 65536 /*Bytes of compressed rows sent in each IDAT chunk*/
+#define QOI_BLOCK 262144 /*Bytes of QOI encoded rows written at a time*/
+#define PALETTE_COLORS 5 /*Colors of the palette the shapes are drawn with*/
+#define GRAPH_BLOCK 262144 /*Samples of a graph file read at a time*/
+#define GRAPH_CHUNK 512 /*Columns of a series placed on rows at a time*/
+#define SCENE_SIDE 4096 /*Width and height of the generated benchmark scenes*/
+#define SCRIPT_BLOCK 65536 /*Bytes read at a time from an input that can't be mapped*/
+#define SERVE_TIMEOUT 30 /*Seconds a --serve request has to arrive, and each reply to be taken*/
+#define SERVE_SCRIPT_MAX 67108864 /*Most bytes of script a --serve request may send*/
+#define SERVE_CANVAS 8192 /*Largest canvas side of a --serve request without --max-canvas*/
+#define CACHE_MAGIC 0x434c4447 /*"GDLC" as a little-endian int*/
+#define CACHE_VERSION 2
+#define CACHE_HEADER 10 /*Ints in the header of a compiled script*/
+#define CACHE_SUFFIX ".gdlc" /*Added to the script name to name its compiled form*/
+#define CACHE_TRIES 16 /*Private names tried for writing a compiled script*/
+#define ANIM_MAGIC 0x414c4447 /*"GDLA" as a little-endian int*/
+#define ANIM_VERSION 1
+#define ANIM_SUFFIX ".gda" /*Added to the script name to name its animation*/
+#define ANIM_FRAME 20 /*Bytes before the name of a frame of an animation*/
+#define FRAME_KEY 0 /*frame holding every pixel*/
+#define FRAME_DELTA 1 /*frame holding the changes from the frame before*/
+#define SHM_MAGIC 0x48534449 /*"IDSH" as a little-endian int*/
+#define SHM_VERSION 1
+#define SHM_HEADER 64 /*Bytes before the picture in a shared memory segment*/
+
+/*Operations of a compiled script. Each is a run of ints, the opcode and*/
+/*then its arguments, already checked and resolved to what the interpreter*/
+/*stores. Paths are stored with their terminating nul, padded to whole ints.*/
+
+#define OP_END 0    /*no arguments*/
+#define OP_POINT 1  /*id, x, y, color*/
+#define OP_LINE 2   /*id, x1, y1, x2, y2, color*/
+#define OP_BOX 3    /*id, left, top, right, bottom, color*/
+#define OP_CIRCLE 4 /*id, x, y, radius, color*/
+#define OP_DELETE 5 /*shape letter, id*/
+#define OP_GRAPH 6  /*color, ints of path, path, series, scale, offset*/
+#define OP_SAVE 7   /*save mode, ints of path, path*/
+#define OP_SIZE 8   /*width, height*/
+#define OP_ERROR 9  /*error flag*/
+
+/*Ways a SAVE writes its file*/
+
+#define SAVE_PLAIN 0
+#define SAVE_MMAP 1 /*draw straight into the memory-mapped file*/
+#define SAVE_RLE 2  /*compress the rows with BI_RLE8*/
+#define SAVE_PNG 3  /*write a palette PNG instead of a bitmap*/
+#define SAVE_QOI 4  /*write a QOI image instead of a bitmap*/
+
+/*Error flags*/
+
+#define NO_ERROR 2
+#define ERR_CREATEFILE 3
+#define ERR_HEADER 4
+#define ERR_POINTMAX 5
+#define ERR_POINT 6
+#define ERR_LINEMAX 7
+#define ERR_LINE 8
+#define ERR_BOXMAX 9
+#define ERR_BOX 10
+#define ERR_BOXCORNER 11
+#define ERR_CIRCLEMAX 12
+#define ERR_RADIUSMAX 13
+#define ERR_CENTER 14
+#define ERR_MOVPT 15
+#define ERR_MOVSHAPE 16
+#define ERR_MEMORY 17
+#define ERR_SIZE 18
+#define ERR_WRITE 19
+#define ERR_READ 20
+#define ERR_COMPILE 21
+#define ERR_OPENFILE 22
+#define ERR_GRAPHFILE 23
+#define ERR_SERIES 24
+#define ERR_SOCKET 25
+#define ERR_BUFFER 26
+
+/*the library gives the same codes*/
+#if (IDRAW_ERR_CREATEFILE != ERR_CREATEFILE) || (IDRAW_ERR_BUFFER != ERR_BUFFER) || (IDRAW_OK == NO_ERROR)
+#error "The error codes of idraw.h don't match the error flags"
+#endif
+
+/*Stages of a run timed by --stats*/
+
+#define STAGE_PARSE 0     /*reading lines and splitting them into words*/
+#define STAGE_DISPATCH 1  /*checking and storing commands, and moving shapes*/
+#define STAGE_RENDER 2    /*clearing and drawing the picture on SAVE*/
+#define STAGE_ENCODE 3    /*writing the file or frame of a SAVE*/
+#define STAGES 4
+
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+/*Kinds of shape, in drawing order*/
+
+#define SHAPE_POINT 0
+#define SHAPE_LINE 1
+#define SHAPE_BOX 2
+#define SHAPE_CIRCLE 3
+#define SHAPE_GRAPH 4  /*the graph series, which are drawn last*/
+#define SHAPE_KINDS 5
+
+/*Kinds of generated benchmark scene*/
+
+#define SCENE_POINTS 0
+#define SCENE_LINES 1
+#define SCENE_BOXES 2
+#define SCENE_CIRCLES 3
+#define SCENE_GRAPH 4
+#define SCENE_CHURN 5
+#define SCENE_KINDS 6
+
+/*Coordinate fields of each shape pool*/
+
+#define PT_X 0
+#define PT_Y 1
+#define LN_X1 0
+#define LN_Y1 1
+#define LN_X2 2
+#define LN_Y2 3
+#define BX_LEFT 0
+#define BX_TOP 1
+#define BX_RIGHT 2
+#define BX_BOTTOM 3
+#define CR_X 0
+#define CR_Y 1
+#define CR_RADIUS 2
+
+/*Structures for objects that can be created using IGuhit*/
+
+/*id_index maps an object number to its slot in a shape pool. It uses open*/
+/*addressing with linear probing, so it only grows with the live objects no*/
+/*matter how large or sparse the object numbers are. Empty buckets hold -1.*/
+
+typedef struct {
+  int *keys;
+  int *slots;
+  int size;   /*number of buckets, always a power of two*/
+  int used;
+} id_index, *id_index_ptr;
+
+/*shape_grid is a uniform grid of GRID_CELL square cells over the canvas.*/
+/*Every cell lists the shapes whose bounding box meets it, with the box, so*/
+/*that the shapes meeting a rectangle are found by looking only at the cells*/
+/*under it. Shapes over more than GRID_LARGE cells go in one extra list after*/
+/*the cells, which every query looks through. The grid is built the first*/
+/*time it is asked about and kept up to date as shapes change afterwards.*/
+
+typedef struct {
+  int x0;  /*bounding box, inclusive, clipped to the canvas*/
+  int y0;
+  int x1;
+  int y1;
+  int id;
+} grid_entry;
+
+typedef struct {
+  grid_entry *entries;
+  int count;
+  int capacity;
+} grid_cell;
+
+typedef struct {
+  grid_cell *cells;  /*columns * rows cells, then the list of large shapes*/
+  int columns;
+  int rows;
+  int width;   /*size of the canvas the grid was built for*/
+  int height;
+  int *found;  /*slots found by the last query*/
+  int found_capacity;
+} shape_grid;
+
+/*shape_pool holds every shape of one kind as packed arrays, one array per*/
+/*coordinate field, plus the color, the object number and an occupied bitset*/
+/*of each slot. Slots are handed out in load order; deleted slots are only*/
+/*cleared in the bitset until the pool is compacted.*/
+
+typedef struct {
+  int *coord[POOL_FIELDS];
+  int *id;
+  char *color;
+  unsigned int *occupied;
+  int fields;
+  int count;    /*number of slots handed out*/
+  int live;     /*number of slots with the occupied bit set*/
+  int capacity;
+  int max_id;   /*largest object number handed a slot so far*/
+  int ordered;  /*slots are in increasing object number*/
+  id_index index;
+  shape_grid grid;
+} shape_pool, *pool_ptr;
+
+typedef shape_pool pts, *pts_ptr;
+typedef shape_pool ln, *ln_ptr;
+typedef shape_pool bx, *bx_ptr;
+typedef shape_pool cir, *cir_ptr;
+
+/*settings holds the command line options that change how a script is drawn*/
+
+typedef struct {
+  int legacy;   /*reproduce the pixels of the original line and circle rasterizers*/
+  int mapped;   /*SAVE draws straight into the memory-mapped output file*/
+  int threads;  /*threads that draw the tiles of a SAVE*/
+  int animated; /*SAVE adds a frame to the script's animation file*/
+  int format;   /*save mode of a SAVE that names none, SAVE_PLAIN for the extension's*/
+  int stats;    /*STATS_TEXT or STATS_JSON prints what a run did when it ends, 0 doesn't*/
+  int max_width;   /*largest canvas a SIZE may ask for, 0 for CANVAS_MAX*/
+  int max_height;
+  int streams;  /*SAVE may write to stdout and inherited descriptors, only from the command line*/
+} settings, *settings_ptr;
+
+/*graph is one series of samples. It keeps, for each column of the canvas,*/
+/*the lowest and highest of the samples of its file that fall in it, and*/
+/*the scale and offset that place a sample on a row.*/
+
+typedef struct {
+  float *low;   /*count lows, then count highs, in one block*/
+  float *high;
+  int count;
+  int id;       /*0 for GRAP, n for Gn*/
+  char color;
+  float scale;
+  float offset;
+} graph, *graph_ptr;
+
+/*graph_set holds the series of a scene in order of id, which is the order*/
+/*they are drawn in*/
+
+typedef struct {
+  graph *series;
+  int count;
+  int capacity;
+} graph_set, *graph_set_ptr;
+
+/*span_filler sets a run of pixels to one color*/
+
+typedef void (*span_filler) (char *pixels, int color, size_t count);
+
+/*canvas is the picture being drawn. Its rows are stored bottom-up with the*/
+/*row stride padded to a multiple of 4 bytes, which is the layout of the*/
+/*pixel rows of the bitmap file, so the file is just the header followed by*/
+/*the pixels. The header is rebuilt whenever the size changes and the pixels*/
+/*are only allocated on SAVE. Drawing only touches the pixels inside the clip*/
+/*rectangle, which is the whole canvas except while a tile is being drawn.*/
+/*The pixels are kept from one SAVE to the next, along with the regions that*/
+/*shapes were added to, moved in or deleted from since, so that only those*/
+/*regions need drawing again.*/
+
+typedef struct {
+  int width;
+  int height;
+  int stride;
+  char *pixels;
+  int clip_x0;  /*drawing is limited to the columns clip_x0 to clip_x1 - 1*/
+  int clip_y0;  /*and the rows clip_y0 to clip_y1 - 1*/
+  int clip_x1;
+  int clip_y1;
+  span_filler fill;  /*fastest span fill of the machine*/
+  long long *drawn;  /*pixels stored by each kind of shape, when they are counted*/
+  int dirty[DIRTY_MAX][4];  /*changed regions as left, bottom, right, top, inclusive*/
+  int dirty_count;
+  int dirty_all;  /*the whole canvas must be drawn again*/
+  unsigned char header[BMP_HEADER];
+} canvas, *canvas_ptr;
+
+#define PIXEL(cv, x, y) ((cv)->pixels[(long) (y) * (cv)->stride + (x)])
+#define IN_CLIP(cv, x, y) (((x) >= (cv)->clip_x0) && ((x) < (cv)->clip_x1) && ((y) >= (cv)->clip_y0) && ((y) < (cv)->clip_y1))
+
+/*animation is an animation file being written. Each SAVE adds a frame*/
+/*named after the file it saves to. The first frame, and any frame after*/
+/*the size changes, holds every pixel; the others hold only what changed*/
+/*from the frame before, which is kept in previous.*/
+/**/
+/*The file starts with ANIM_MAGIC and ANIM_VERSION. Every frame then has*/
+/*its kind, width, height, name length and data length, as little-endian*/
+/*ints, followed by the name and the data. A key frame's data is the pixel*/
+/*rows as they are in a bitmap. A delta frame's data is a list of runs, each*/
+/*a count of unchanged bytes, a count of changed bytes, then the changed*/
+/*bytes XORed with the frame before. The counts are written 7 bits to a*/
+/*byte, low bits first, with the top bit set on every byte but the last.*/
+
+typedef struct {
+  int fd;
+  char *previous;
+  int width;
+  int height;
+  int frames;
+  unsigned char *delta;
+  size_t delta_capacity;
+} animation, *animation_ptr;
+
+/*run_stats is what --stats counts over a run. Without it no counting is*/
+/*done beyond a test of the pointer to it.*/
+
+typedef struct {
+  double seconds[STAGES];
+  long long lines;                   /*script lines read*/
+  long long commands[OP_ERROR + 1];  /*commands by operation, OP_END for unknown words*/
+  long long moves;
+  long long pixels[SHAPE_KINDS];     /*pixels stored by each kind of shape*/
+  long long bytes;                   /*bytes of files and frames saved*/
+  int saves;
+  int partial;                       /*SAVEs that only drew the changed regions*/
+} run_stats, *run_stats_ptr;
+
+/*scene holds everything a script has created, the canvas and the options*/
+
+typedef struct {
+  pts points;
+  ln lines;
+  bx boxes;
+  cir circles;
+  graph_set graphs;
+  canvas cv;
+  settings options;
+  animation_ptr anim;  /*animation the SAVEs go to, or NULL*/
+  run_stats_ptr stats;  /*counters of --stats, or NULL*/
+  int reply;    /*connection of the --serve request being run, or -1*/
+  int scratch;  /*file a SAVE - is written to before it goes on reply*/
+} scene, *scene_ptr;
+
+/*idraw_context is a scene driven through the library interface of idraw.h*/
+
+struct idraw_context {
+  scene sc;
+  int lines;       /*lines fed so far*/
+  int error_line;  /*line that last failed, 0 for none*/
+};
+
+/*field is one word of a command line. It points into the line it was read*/
+/*from instead of holding a copy, and keeps the word read as a number.*/
+
+typedef struct {
+  const char *text;
+  int length;
+  int value;    /*the word read as a number the way atoi reads it*/
+} field, *field_ptr;
+
+/*command is a line split into its command word and the comma-separated*/
+/*fields after it. Fields missing from the line are empty.*/
+
+typedef struct {
+  field word[PARAM_MAX];
+  int count;
+} command, *command_ptr;
+
+/*script is the input file being interpreted. A regular file is mapped whole;*/
+/*anything else, like a pipe, is read in SCRIPT_BLOCK pieces into a buffer that*/
+/*only grows when a single line doesn't fit. Lines are handed out as slices of*/
+/*data, so nothing is copied or cleared per line.*/
+
+typedef struct {
+  int fd;
+  char *data;
+  size_t size;      /*bytes of script text in data*/
+  size_t pos;       /*start of the next line in data*/
+  size_t capacity;  /*size of the read buffer, 0 when data is mapped*/
+  int eof;
+  size_t taken;     /*bytes read from fd so far*/
+  size_t limit;     /*most bytes that may be read, 0 for no limit*/
+  double deadline;  /*stats_clock time reading must be done by, 0 for none*/
+} script, *script_ptr;
+
+/*job_queue is the run of scripts a batch worker owns. The owner takes*/
+/*scripts from the front and idle workers steal half of the rest from the*/
+/*back.*/
+
+typedef struct {
+  pthread_mutex_t lock;
+  int head;
+  int tail;
+} job_queue, *job_queue_ptr;
+
+/*batch is a list of scripts rendered in one process, each on a scene of its*/
+/*own, with the error each one stopped on*/
+
+typedef struct {
+  char **scripts;
+  int *errors;
+  int count;
+  int capacity;
+  job_queue *queues;
+  int workers;
+  settings options;
+  int width;    /*starting canvas size of every script*/
+  int height;
+  int compile;
+} batch, *batch_ptr;
+
+typedef struct {
+  batch_ptr jobs;
+  int id;
+  pthread_t thread;
+} worker, *worker_ptr;
+
+/*server is the socket of --serve and what every request starts with. Each*/
+/*of its workers accepts requests on the socket and runs them on a scene of*/
+/*its own, kept from one request to the next.*/
+
+typedef struct {
+  int listener;
+  settings options;
+  int width;    /*starting canvas size of every request*/
+  int height;
+  pthread_mutex_t lock;
+  long long served;  /*requests answered so far*/
+} server, *server_ptr;
+
+typedef struct {
+  server_ptr srv;
+  int scratch;  /*unlinked file for the pictures of SAVE -*/
+  pthread_t thread;
+} server_worker, *server_worker_ptr;
+
+/*tile_bins lists for every tile of the canvas the slots of each kind of*/
+/*shape whose bounding box touches it, in drawing order. The entries of*/
+/*tile t of kind k are slots[k][start[k][t]] up to slots[k][start[k][t + 1]].*/
+
+typedef struct {
+  scene_ptr sc;
+  int columns;  /*tiles across the canvas*/
+  int rows;     /*tiles up the canvas*/
+  int *start[4];
+  int *slots[4];
+  int next;     /*next tile to be drawn*/
+  pthread_mutex_t lock;
+} tile_bins, *tile_bins_ptr;
+
+/*op_stream is a compiled script being built*/
+
+typedef struct {
+  int *ops;
+  size_t count;
+  size_t capacity;
+} op_stream, *op_stream_ptr;
+
+/*png_writer is a PNG being written a row at a time: one block of fixed*/
+/*Huffman codes whose matches reach back one byte or one row*/
+
+typedef struct {
+  int fd;
+  int error;
+  unsigned char *block;     /*compressed bytes of the next IDAT chunk*/
+  size_t used;
+  unsigned long long bits;  /*bits not yet sent, first bit lowest*/
+  int count;
+  unsigned long adler_a;    /*Adler-32 of the rows so far*/
+  unsigned long adler_b;
+  unsigned char *window;    /*the row before, then the row being sent*/
+  size_t row_length;        /*filter byte and pixels of a row*/
+  int rows;
+  unsigned int row_code;    /*distance code of a match with the row above*/
+  unsigned int row_extra;
+  int row_extra_bits;
+} png_writer, *png_writer_ptr;
+
+/*qoi_writer is a QOI image being written a row at a time*/
+
+typedef struct {
+  int fd;
+  int width;
+  unsigned char *block;
+  size_t used;
+  size_t capacity;
+  unsigned int palette[256];  /*each palette entry as red, green, blue, alpha*/
+  unsigned int index[64];
+  unsigned int previous;
+  int run;
+} qoi_writer, *qoi_writer_ptr;
+
+/*shm_control starts a shared memory segment that SAVE shm:/name writes.*/
+/*The picture follows it at SHM_HEADER. ready is 0 while a picture is being*/
+/*written and 1 once it is complete, when frame has been counted up.*/
+
+typedef struct {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int ready;
+  unsigned int frame;        /*pictures completed so far*/
+  unsigned long long size;   /*bytes of the picture*/
+} shm_control, *shm_control_ptr;
+
+/*Function Prototypes*/
+
+static void put_le32 (unsigned char *at, unsigned long value);
+
+void BMPheader (canvas_ptr cv);
+int write_image (int fd, canvas_ptr cv);
+int write_rle (int fd, canvas_ptr cv);
+int write_rle_stream (int fd, canvas_ptr cv);
+int png_start (png_writer_ptr w, int fd, canvas_ptr cv);
+void png_row (png_writer_ptr w, const char *pixels);
+int png_finish (png_writer_ptr w);
+int write_png (int fd, canvas_ptr cv);
+int qoi_start (qoi_writer_ptr w, int fd, canvas_ptr cv);
+int qoi_row (qoi_writer_ptr w, const char *pixels);
+int qoi_finish (qoi_writer_ptr w);
+int write_qoi (int fd, canvas_ptr cv);
+#ifdef IDRAW_BENCH
+int bench_save (void);
+int scene_kind (const char *name);
+int gen_scene (FILE *out, int kind, int count, const char *data);
+int gen_graph (const char *path, int count);
+int bench_scenes (int scale);
+#endif
+int write_parts (int fd, struct iovec *iov, int count);
+void render_scene (scene_ptr sc);
+int render_tiles (scene_ptr sc);
+int save_mapped (int fd, scene_ptr sc);
+int round_off (double entry);
+int round_printf (double entry);
+double compute_slope (int x1, int y1, int x2, int y2);
+int compute_diff(int, int);
+int script_open (script_ptr s, const char *filename);
+int script_attach (script_ptr s, int fd);
+int script_line (script_ptr s, char **line, size_t *length);
+void script_close (script_ptr s);
+int tokenize (const char *line, size_t length, command_ptr cmd);
+int field_number (field_ptr f);
+int field_is (field_ptr f, const char *word);
+int graph_word (field_ptr f);
+int field_path (field_ptr f, char *path, int size);
+float field_float (field_ptr f, float otherwise);
+int interpret (script_ptr input, scene_ptr sc);
+int run_script (const char *filename, settings_ptr options, int width, int height, int compile);
+double stats_clock (void);
+void print_stats (const char *filename, run_stats_ptr st, scene_ptr sc, int format);
+void batch_init (batch_ptr b, settings_ptr options, int width, int height, int compile);
+int batch_add (batch_ptr b, const char *filename, size_t length);
+int batch_read_list (batch_ptr b, const char *listname);
+int batch_run (batch_ptr b, int threads);
+void batch_free (batch_ptr b);
+int serve (const char *path, settings_ptr options, int width, int height, int threads);
+int scratch_file (void);
+int serve_request (server_ptr srv, scene_ptr sc, int conn);
+int send_reply (scene_ptr sc, const char *path);
+void reset_scene (scene_ptr sc, int width, int height);
+int process (command_ptr cmd, scene_ptr sc);
+unsigned long long hash_bytes (const void *data, size_t size, unsigned long long hash);
+char *cache_name (const char *filename);
+int compile_script (script_ptr input, const char *filename, scene_ptr sc);
+int compile_command (command_ptr cmd, scene_ptr sc, op_stream_ptr stream);
+int run_cached (script_ptr input, const char *filename, scene_ptr sc);
+int run_compiled (const int *ops, size_t count, scene_ptr sc);
+void initialize_scene (scene_ptr sc);
+void release_scene (scene_ptr sc);
+void initialize_pts (pts_ptr ps);
+void initialize_ln (ln_ptr ls);
+void initialize_bx (bx_ptr bs);
+void initialize_cir (cir_ptr cs);
+void initialize_graph (graph_ptr g);
+void initialize_graphs (graph_set_ptr gs);
+void release_graphs (graph_set_ptr gs);
+void initialize_canvas (canvas_ptr cv);
+int resize_canvas (canvas_ptr cv, int width, int height);
+int clear_canvas (canvas_ptr cv);
+int radius_max (canvas_ptr cv);
+void pool_init (pool_ptr p, int fields);
+void pool_free (pool_ptr p);
+void pool_clear (pool_ptr p);
+int pool_find (pool_ptr p, int id);
+int pool_insert (pool_ptr p, int id);
+void pool_remove (pool_ptr p, int id);
+int pool_compact (pool_ptr p);
+int pool_next (pool_ptr p, int slot);
+int shape_bounds (canvas_ptr cv, pool_ptr p, int kind, int slot, int *x0, int *y0, int *x1, int *y1);
+void mark_dirty (canvas_ptr cv, int x0, int y0, int x1, int y1);
+void detach_shape (canvas_ptr cv, pool_ptr p, int kind, int slot);
+void attach_shape (canvas_ptr cv, pool_ptr p, int kind, int slot);
+void grid_free (shape_grid *g);
+int grid_ready (pool_ptr p, int kind, canvas_ptr cv);
+int grid_query (pool_ptr p, int x0, int y0, int x1, int y1);
+#ifdef IDRAW_BENCH
+int bench_grid (void);
+#endif
+int place_shape (canvas_ptr cv, pool_ptr p, int kind, int id);
+void remove_shape (canvas_ptr cv, pool_ptr p, int kind, int id);
+int redraw_dirty (scene_ptr sc);
+void draw_shape (canvas_ptr cv, pool_ptr p, int kind, int slot, int legacy);
+int save_work (command_ptr cmd, scene_ptr sc);
+int save_image (const char *path, int mode, scene_ptr sc);
+int draw_scene (scene_ptr sc, int *partial);
+int open_output (const char *path, scene_ptr sc, shm_control_ptr *control);
+int special_output (const char *path);
+int save_mode (field_ptr f);
+int path_format (const char *path);
+void print_error (int);
+const char *error_message (int error);
+int set_size (command_ptr cmd, scene_ptr sc);
+int scene_size (scene_ptr sc, int width, int height);
+int load_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv);
+int load_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv);
+int load_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv);
+int load_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv);
+int load_graph (command_ptr cmd, graph_set_ptr gs, canvas_ptr cv);
+int load_series (graph_set_ptr gs, int id, const char *path, int color, float scale, float offset, canvas_ptr cv);
+int read_graph (const char *path, int color, graph_ptr g, canvas_ptr cv);
+graph_ptr place_series (graph_set_ptr gs, int id);
+void delete_series (graph_set_ptr gs, int id, canvas_ptr cv);
+void sample_range (const float *samples, size_t count, float *low, float *high);
+void delete_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv);
+void delete_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv);
+void delete_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv);
+void delete_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv);
+int move_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv);
+int move_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv);
+int move_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv);
+int move_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv);
+void graph_rows (const float *values, int count, float scale, float offset, int height, int *rows);
+void create_graph (canvas_ptr cv, graph_set_ptr gs);
+void compute_midpt (int*, int*, int, int, int, int);
+void create_point (canvas_ptr cv, pts_ptr ps);
+void create_line (canvas_ptr cv, ln_ptr ls, int legacy);
+void draw_line (canvas_ptr cv, int xa, int ya, int xb, int yb, char color);
+void draw_line_legacy (canvas_ptr cv, int xa, int ya, int xb, int yb, char color);
+void create_box (canvas_ptr cv, bx_ptr bs);
+void draw_box (canvas_ptr cv, int left, int top, int right, int bottom, char color);
+void fill_scalar (char *pixels, int color, size_t count);
+void fill_sse2 (char *pixels, int color, size_t count);
+void fill_avx2 (char *pixels, int color, size_t count);
+span_filler choose_span_fill (void);
+#ifdef IDRAW_BENCH
+int bench_fill (void);
+#endif
+void create_circle (canvas_ptr cv, cir_ptr cs, int legacy);
+void draw_disc (canvas_ptr cv, int cenx, int ceny, int rad, char color);
+void draw_circle_legacy (canvas_ptr cv, int cenx, int ceny, int rad, char color);
+int check_round (void);
+int anim_open (animation_ptr a, const char *filename);
+int anim_frame (animation_ptr a, const char *name, canvas_ptr cv);
+int anim_close (animation_ptr a);
+int anim_extract (const char *filename, const char *directory);
+
+/*MAIN FUNCTION*/
+
+#ifndef IDRAW_LIBRARY
+
+int main (int argc, char **argv)
+{
+  settings options;
+  canvas probe;
+  batch jobs;
+  char *filename = NULL, *listname = NULL, *socketname = NULL;
+  int error = NO_ERROR, count, failed, width = PIXEL_MAX, height = PIXEL_MAX;
+  int compile = 0, batched = 0, threads = 0;
+
+  memset (&options, 0, sizeof(settings));
+  options.streams = 1;
+  initialize_canvas (&probe);
+
+  for (count = 1; count < argc; count++)
+  {
+     if (strcmp(argv[count], "--legacy") == 0) options.legacy = 1;
+     else if (strcmp(argv[count], "--mmap") == 0) options.mapped = 1;
+     else if (strcmp(argv[count], "--rle") == 0) options.format = SAVE_RLE;
+     else if (strcmp(argv[count], "--png") == 0) options.format = SAVE_PNG;
+     else if (strcmp(argv[count], "--qoi") == 0) options.format = SAVE_QOI;
+     else if (strcmp(argv[count], "--compile") == 0) compile = 1;
+     else if (strcmp(argv[count], "--batch") == 0) batched = 1;
+     else if (strcmp(argv[count], "--anim") == 0) options.animated = 1;
+     else if (strcmp(argv[count], "--stats") == 0) options.stats = STATS_TEXT;
+     else if (strcmp(argv[count], "--stats=json") == 0) options.stats = STATS_JSON;
+     else if ((strcmp(argv[count], "--extract") == 0) && (count + 2 < argc))
+     {
+        error = anim_extract (argv[count + 1], argv[count + 2]);
+        if (error != NO_ERROR) print_error (error);
+        return (error == NO_ERROR) ? 0 : 1;
+     }
+#ifdef IDRAW_BENCH
+     else if (strcmp(argv[count], "--bench-fill") == 0) return (bench_fill() == NO_ERROR) ? 0 : 1;
+     else if (strcmp(argv[count], "--bench-grid") == 0) return (bench_grid() == NO_ERROR) ? 0 : 1;
+     else if (strcmp(argv[count], "--bench-save") == 0) return (bench_save() == NO_ERROR) ? 0 : 1;
+     else if (strcmp(argv[count], "--bench-scenes") == 0)
+     {
+        error = bench_scenes ((count + 1 < argc) ? atoi(argv[count + 1]) : 1);
+        if (error != NO_ERROR) print_error (error);
+        return (error == NO_ERROR) ? 0 : 1;
+     }
+     else if ((strcmp(argv[count], "--gen-scene") == 0) && (count + 2 < argc))
+     {
+        /*a graph scene reads its samples from graph.bin. The script ends by*/
+        /*saving the picture as KIND.bmp.*/
+        if (scene_kind(argv[count + 1]) < 0) error = ERR_OPENFILE;
+        if ((error == NO_ERROR) && (scene_kind(argv[count + 1]) == SCENE_GRAPH))
+          error = gen_graph ("graph.bin", (atoi(argv[count + 2]) < CANVAS_MAX) ? atoi(argv[count + 2]) : CANVAS_MAX);
+        if (error == NO_ERROR) error = gen_scene (stdout, scene_kind(argv[count + 1]), atoi(argv[count + 2]), "graph.bin");
+        if (error == NO_ERROR) printf ("SAVE %s.bmp\n", argv[count + 1]);
+        if (error != NO_ERROR) print_error (error);
+        return (error == NO_ERROR) ? 0 : 1;
+     }
+#endif
+     else if ((strcmp(argv[count], "--list") == 0) && (count + 1 < argc))
+     {
+        batched = 1;
+        listname = argv[++count];
+     }
+     else if ((strcmp(argv[count], "--serve") == 0) && (count + 1 < argc)) socketname = argv[++count];
+     else if ((strcmp(argv[count], "--threads") == 0) && (count + 1 < argc))
+     {
+        threads = atoi(argv[++count]);
+        if (threads < 1)
+        {
+           printf ("ERROR: Invalid number of threads!\n");
+           return 1;
+        }
+     }
+     else if (strcmp(argv[count], "--check-round") == 0) return check_round();
+     else if ((strcmp(argv[count], "--size") == 0) && (count + 1 < argc))
+     {
+        count++;
+        if ((sscanf(argv[count], "%dx%d", &width, &height) != 2) || (resize_canvas(&probe, width, height) != NO_ERROR))
+        {
+           print_error (ERR_SIZE);
+           return 1;
+        }
+     }
+     else if ((strcmp(argv[count], "--max-canvas") == 0) && (count + 1 < argc))
+     {
+        count++;
+        if ((sscanf(argv[count], "%dx%d", &options.max_width, &options.max_height) != 2)
+            || (resize_canvas(&probe, options.max_width, options.max_height) != NO_ERROR))
+        {
+           print_error (ERR_SIZE);
+           return 1;
+        }
+     }
+     else if (argv[count][0] == '-')
+     {
+        printf ("ERROR: Unknown option %s!\n", argv[count]);
+        return 1;
+     }
+     else filename = argv[count];
+  }
+
+  if (socketname != NULL)
+  {
+     error = serve (socketname, &options, width, height, threads);
+     if (error != NO_ERROR) print_error (error);
+     return (error == NO_ERROR) ? 0 : 1;
+  }
+
+  if (batched)
+  {
+     /*scripts come from the command line, a list file, or else stdin. The*/
+     /*scripts already run in parallel, so each draws on one thread.*/
+     options.threads = 1;
+     batch_init (&jobs, &options, width, height, compile);
+     for (count = 1; (count < argc) && (error == NO_ERROR); count++)
+     {
+        if ((strcmp(argv[count], "--list") == 0) || (strcmp(argv[count], "--threads") == 0) || (strcmp(argv[count], "--size") == 0)
+            || (strcmp(argv[count], "--max-canvas") == 0)) count++;
+        else if (argv[count][0] != '-') error = batch_add (&jobs, argv[count], strlen(argv[count]));
+     }
+     if ((error == NO_ERROR) && (listname != NULL)) error = batch_read_list (&jobs, listname);
+     else if ((error == NO_ERROR) && (jobs.count == 0)) error = batch_read_list (&jobs, "-");
+     if (error == NO_ERROR) error = batch_run (&jobs, threads);
+     if (error != NO_ERROR)
+     {
+        print_error (error);
+        batch_free (&jobs);
+        return 1;
+     }
+
+     failed = 0;
+     for (count = 0; count < jobs.count; count++)
+     {
+        if (jobs.errors[count] == NO_ERROR) continue;
+        printf ("%s: %s\n", jobs.scripts[count], error_message(jobs.errors[count]));
+        failed++;
+     }
+     if (failed > 0) printf ("%d of %d scripts failed.\n", failed, jobs.count);
+     batch_free (&jobs);
+     return (failed == 0) ? 0 : 1;
+  }
+
+  if (filename == NULL) 
+  {
+     printf ("ERROR: Input file not specified!\n");
+     return 1;
+  }
+
+  options.threads = (threads > 0) ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  error = run_script (filename, &options, width, height, compile);
+  if (error != NO_ERROR) print_error (error);
+  return (error == NO_ERROR) ? 0 : 1;
+}
+
+#endif
+
+/*run_script runs one script from the start on a scene of its own, or only*/
+/*compiles it when compile is set, and returns the error it stopped on*/
+
+int run_script (const char *filename, settings_ptr options, int width, int height, int compile)
+{
+  script input;
+  scene sc;
+  animation anim;
+  run_stats st;
+  double start = 0;
+  int error, closed;
+
+  if (script_open(&input, filename) != NO_ERROR) return ERR_OPENFILE;
+
+  initialize_scene (&sc);
+  sc.options = *options;
+  if (options->stats)
+    {
+      memset(&st, 0, sizeof(run_stats));
+      sc.stats = &st;
+      sc.cv.drawn = st.pixels;
+      start = stats_clock();
+    }
+  error = resize_canvas (&sc.cv, width, height);
+  if ((error == NO_ERROR) && options->animated && !compile)
+    {
+      error = anim_open (&anim, (strcmp(filename, "-") == 0) ? "stdin" : filename);
+      if (error == NO_ERROR) sc.anim = &anim;
+    }
+  if ((error == NO_ERROR) && compile)
+    {
+      error = compile_script (&input, filename, &sc);
+      if (error == -1)
+	{
+	  /*without a compiled form the script is run as it is*/
+	  input.pos = 0;
+	  reset_scene (&sc, width, height);
+	  error = interpret (&input, &sc);
+	}
+    }
+  else if (error == NO_ERROR)
+    {
+      error = run_cached (&input, filename, &sc);
+      if (error == -1) error = interpret (&input, &sc);
+    }
+  if (sc.anim != NULL)
+    {
+      closed = anim_close (sc.anim);
+      if (error == NO_ERROR) error = closed;
+    }
+  if (sc.stats != NULL)
+    {
+      /*what isn't spent running commands went to reading the script*/
+      st.seconds[STAGE_PARSE] = stats_clock() - start - st.seconds[STAGE_DISPATCH];
+      st.seconds[STAGE_DISPATCH] -= st.seconds[STAGE_RENDER] + st.seconds[STAGE_ENCODE];
+      print_stats (filename, &st, &sc, options->stats);
+    }
+  script_close (&input);
+  release_scene (&sc);
+  return error;
+}
+
+/*stats_clock gives the seconds of the monotonic clock*/
+
+double stats_clock (void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*print_stats prints the counters and stage times of a run to stderr, as*/
+/*text or as one line of JSON. The lines of a run are printed together, so*/
+/*the runs of a batch don't mix.*/
+
+void print_stats (const char *filename, run_stats_ptr st, scene_ptr sc, int format)
+{
+  static const char *stages[STAGES] = { "parse", "dispatch", "render", "encode" };
+  static const char *commands[OP_ERROR + 1] = { "other", "point", "line", "box", "circle", "delete", "graph", "save", "size", "error" };
+  static const char *shapes[SHAPE_KINDS] = { "point", "line", "box", "circle", "graph" };
+  int live[SHAPE_KINDS], count;
+
+  live[SHAPE_POINT] = sc->points.live;
+  live[SHAPE_LINE] = sc->lines.live;
+  live[SHAPE_BOX] = sc->boxes.live;
+  live[SHAPE_CIRCLE] = sc->circles.live;
+  live[SHAPE_GRAPH] = sc->graphs.count;
+
+  flockfile(stderr);
+  if (format == STATS_JSON)
+    {
+      fprintf (stderr, "{\"script\": \"");
+      for (count = 0; filename[count] != '\0'; count++)
+	{
+	  if ((filename[count] == '"') || (filename[count] == '\\')) fputc('\\', stderr);
+	  if ((unsigned char) filename[count] >= ' ') fputc(filename[count], stderr);
+	}
+      fprintf (stderr, "\", \"seconds\": {");
+      for (count = 0; count < STAGES; count++) fprintf (stderr, "%s\"%s\": %.6f", count ? ", " : "", stages[count], st->seconds[count]);
+      fprintf (stderr, "}, \"lines\": %lld, \"commands\": {", st->lines);
+      for (count = 0; count <= OP_ERROR; count++) fprintf (stderr, "\"%s\": %lld, ", commands[count], st->commands[count]);
+      fprintf (stderr, "\"move\": %lld}, \"live\": {", st->moves);
+      for (count = 0; count < SHAPE_KINDS; count++) fprintf (stderr, "%s\"%s\": %d", count ? ", " : "", shapes[count], live[count]);
+      fprintf (stderr, "}, \"pixels\": {");
+      for (count = 0; count < SHAPE_KINDS; count++) fprintf (stderr, "%s\"%s\": %lld", count ? ", " : "", shapes[count], st->pixels[count]);
+      fprintf (stderr, "}, \"saves\": %d, \"partial_saves\": %d, \"bytes\": %lld}\n", st->saves, st->partial, st->bytes);
+    }
+  else
+    {
+      fprintf (stderr, "%s:\n  time    ", filename);
+      for (count = 0; count < STAGES; count++) fprintf (stderr, " %s %.3f ms", stages[count], st->seconds[count] * 1e3);
+      fprintf (stderr, "\n  lines    %lld\n  commands", st->lines);
+      for (count = 0; count <= OP_ERROR; count++)
+	if (st->commands[count] > 0) fprintf (stderr, " %s %lld", commands[count], st->commands[count]);
+      if (st->moves > 0) fprintf (stderr, " move %lld", st->moves);
+      fprintf (stderr, "\n  live    ");
+      for (count = 0; count < SHAPE_KINDS; count++) fprintf (stderr, " %s %d", shapes[count], live[count]);
+      fprintf (stderr, "\n  pixels  ");
+      for (count = 0; count < SHAPE_KINDS; count++) fprintf (stderr, " %s %lld", shapes[count], st->pixels[count]);
+      fprintf (stderr, "\n  saves    %d (%d of changed regions only), %lld bytes\n", st->saves, st->partial, st->bytes);
+    }
+  funlockfile(stderr);
+}
+
+/*batch_init prepares an empty batch whose scripts all start with the given*/
+/*options and canvas size*/
+
+void batch_init (batch_ptr b, settings_ptr options, int width, int height, int compile)
+{
+  b->scripts = NULL;
+  b->errors = NULL;
+  b->count = 0;
+  b->capacity = 0;
+  b->queues = NULL;
+  b->workers = 0;
+  b->options = *options;
+  b->width = width;
+  b->height = height;
+  b->compile = compile;
+}
+
+/*batch_add adds a copy of the script name filename to the batch*/
+
+int batch_add (batch_ptr b, const char *filename, size_t length)
+{
+  char **scripts;
+  int capacity;
+
+  if (b->count == b->capacity)
+    {
+      capacity = (b->capacity == 0) ? 64 : b->capacity * 2;
+      scripts = realloc(b->scripts, capacity * sizeof(char *));
+      if (scripts == NULL) return ERR_MEMORY;
+      b->scripts = scripts;
+      b->capacity = capacity;
+    }
+  b->scripts[b->count] = malloc(length + 1);
+  if (b->scripts[b->count] == NULL) return ERR_MEMORY;
+  memcpy(b->scripts[b->count], filename, length);
+  b->scripts[b->count][length] = '\0';
+  b->count++;
+  return NO_ERROR;
+}
+
+/*batch_read_list adds the scripts named one per line in listname, which is*/
+/*stdin when it is "-". Blanks around names and blank lines are skipped.*/
+
+int batch_read_list (batch_ptr b, const char *listname)
+{
+  script list;
+  char *line;
+  size_t length;
+  int error = NO_ERROR, status;
+
+  if (script_open(&list, listname) != NO_ERROR) return ERR_OPENFILE;
+  while ((error == NO_ERROR) && ((status = script_line(&list, &line, &length)) > 0))
+    {
+      while ((length > 0) && isspace((unsigned char) *line))
+	{
+	  line++;
+	  length--;
+	}
+      while ((length > 0) && isspace((unsigned char) line[length - 1])) length--;
+      if (length > 0) error = batch_add(b, line, length);
+    }
+  if ((error == NO_ERROR) && (status < 0)) error = ERR_READ;
+  script_close(&list);
+  return error;
+}
+
+/*next_job hands worker id the next script to run: the front of its own*/
+/*queue, or else the upper half of the first other queue with work left,*/
+/*which becomes its own queue. It returns -1 when every queue is empty.*/
+
+static int next_job (batch_ptr b, int id)
+{
+  job_queue_ptr own = &b->queues[id], victim;
+  int job = -1, count, middle, tail;
+
+  pthread_mutex_lock(&own->lock);
+  if (own->head < own->tail) job = own->head++;
+  pthread_mutex_unlock(&own->lock);
+  if (job >= 0) return job;
+
+  for (count = 1; count < b->workers; count++)
+    {
+      victim = &b->queues[(id + count) % b->workers];
+      pthread_mutex_lock(&victim->lock);
+      if (victim->head < victim->tail)
+	{
+	  tail = victim->tail;
+	  middle = victim->head + (victim->tail - victim->head) / 2;
+	  victim->tail = middle;
+	  pthread_mutex_unlock(&victim->lock);
+
+	  pthread_mutex_lock(&own->lock);
+	  own->head = middle + 1;
+	  own->tail = tail;
+	  pthread_mutex_unlock(&own->lock);
+	  return middle;
+	}
+      pthread_mutex_unlock(&victim->lock);
+    }
+  return -1;
+}
+
+/*batch_worker runs scripts of the batch until there are none left*/
+
+static void *batch_worker (void *arg)
+{
+  worker_ptr w = arg;
+  batch_ptr b = w->jobs;
+  int job;
+
+  while ((job = next_job(b, w->id)) >= 0)
+    {
+      b->errors[job] = run_script(b->scripts[job], &b->options, b->width, b->height, b->compile);
+    }
+  return NULL;
+}
+
+/*batch_run runs every script of the batch on threads workers, one per core*/
+/*when threads is 0. Each script's error is left in errors.*/
+
+int batch_run (batch_ptr b, int threads)
+{
+  worker_ptr workers;
+  int count, started;
+
+  if (b->count == 0) return NO_ERROR;
+  if (threads < 1) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1) threads = 1;
+  if (threads > b->count) threads = b->count;
+
+  b->errors = malloc(b->count * sizeof(int));
+  b->queues = malloc(threads * sizeof(job_queue));
+  workers = malloc(threads * sizeof(worker));
+  if ((b->errors == NULL) || (b->queues == NULL) || (workers == NULL))
+    {
+      free(workers);
+      return ERR_MEMORY;
+    }
+
+  /*every worker starts with an even share of the scripts*/
+  b->workers = threads;
+  for (count = 0; count < threads; count++)
+    {
+      pthread_mutex_init(&b->queues[count].lock, NULL);
+      b->queues[count].head = (int) ((long) b->count * count / threads);
+      b->queues[count].tail = (int) ((long) b->count * (count + 1) / threads);
+      workers[count].jobs = b;
+      workers[count].id = count;
+    }
+  for (count = 0; count < b->count; count++) b->errors[count] = NO_ERROR;
+
+  /*the calling thread is worker 0*/
+  for (started = 1; started < threads; started++)
+    {
+      if (pthread_create(&workers[started].thread, NULL, batch_worker, &workers[started]) != 0) break;
+    }
+  batch_worker(&workers[0]);
+  for (count = 1; count < started; count++) pthread_join(workers[count].thread, NULL);
+
+  for (count = 0; count < threads; count++) pthread_mutex_destroy(&b->queues[count].lock);
+  free(workers);
+  return NO_ERROR;
+}
+
+/*batch_free releases the script names and results of a batch*/
+
+void batch_free (batch_ptr b)
+{
+  int count;
+
+  for (count = 0; count < b->count; count++) free(b->scripts[count]);
+  free(b->scripts);
+  free(b->errors);
+  free(b->queues);
+  b->scripts = NULL;
+  b->errors = NULL;
+  b->queues = NULL;
+  b->count = 0;
+}
+
+/*serve_worker answers requests on the server's socket for as long as it*/
+/*can accept them. Its scene, with the canvas and a scratch file for SAVE -,*/
+/*lasts from one request to the next and is emptied after each reply, so a*/
+/*request finds its memory ready and its pixels already cleared.*/
+
+static void *serve_worker (void *arg)
+{
+  server_worker_ptr w = arg;
+  server_ptr srv = w->srv;
+  scene sc;
+  int conn;
+
+  initialize_scene (&sc);
+  sc.options = srv->options;
+  reset_scene (&sc, srv->width, srv->height);
+  sc.scratch = w->scratch;
+
+  for (;;)
+    {
+      conn = accept(srv->listener, NULL, NULL);
+      if ((conn < 0) && ((errno == EINTR) || (errno == ECONNABORTED))) continue;
+      if (conn < 0) break;
+      serve_request (srv, &sc, conn);
+      close(conn);
+      reset_scene (&sc, srv->width, srv->height);
+    }
+  release_scene (&sc);
+  return NULL;
+}
+
+/*scratch_file makes the unlinked temporary file a --serve worker keeps the*/
+/*pictures of SAVE - in, and returns its descriptor or -1*/
+
+int scratch_file (void)
+{
+  char name[PATH_MAX];
+  const char *dir;
+  int fd;
+
+  dir = getenv("TMPDIR");
+  if ((dir == NULL) || (dir[0] == '\0')) dir = "/tmp";
+  snprintf(name, sizeof(name), "%s/idrawXXXXXX", dir);
+  fd = mkstemp(name);
+  if (fd >= 0) unlink(name);
+  return fd;
+}
+
+/*serve listens on the Unix socket path and runs the script of every*/
+/*connection on a pool of threads workers, one per core when threads is 0.*/
+/*It only returns if the socket or the workers can't be set up, or every*/
+/*worker stops.*/
+
+int serve (const char *path, settings_ptr options, int width, int height, int threads)
+{
+  struct sockaddr_un address;
+  struct stat info;
+  server srv;
+  server_worker_ptr workers;
+  int count, started, error = NO_ERROR;
+
+  if (strlen(path) >= sizeof(address.sun_path)) return ERR_SOCKET;
+  if ((width > ((options->max_width > 0) ? options->max_width : SERVE_CANVAS))
+      || (height > ((options->max_height > 0) ? options->max_height : SERVE_CANVAS))) return ERR_SIZE;
+  if (threads < 1) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1) threads = 1;
+
+  /*a client going away mid-reply is an error for that request only*/
+  signal(SIGPIPE, SIG_IGN);
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  /*a socket left behind by an earlier server is replaced*/
+  if ((lstat(path, &info) == 0) && S_ISSOCK(info.st_mode)) unlink(path);
+  srv.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (srv.listener < 0) return ERR_SOCKET;
+  if ((bind(srv.listener, (struct sockaddr *) &address, sizeof(address)) != 0) || (listen(srv.listener, SOMAXCONN) != 0))
+    {
+      close(srv.listener);
+      return ERR_SOCKET;
+    }
+
+  /*requests already run in parallel, so each draws on one thread and none*/
+  /*writes an animation. The descriptors of the server are not the client's*/
+  /*to write to.*/
+  srv.options = *options;
+  srv.options.threads = 1;
+  srv.options.animated = 0;
+  srv.options.streams = 0;
+  if (srv.options.max_width == 0)
+    {
+      srv.options.max_width = SERVE_CANVAS;
+      srv.options.max_height = SERVE_CANVAS;
+    }
+  srv.width = width;
+  srv.height = height;
+  srv.served = 0;
+  pthread_mutex_init(&srv.lock, NULL);
+
+  workers = malloc(threads * sizeof(server_worker));
+  if (workers == NULL) error = ERR_MEMORY;
+  for (count = 0; (workers != NULL) && (count < threads); count++)
+    {
+      workers[count].srv = &srv;
+      workers[count].scratch = (error == NO_ERROR) ? scratch_file() : -1;
+      if (workers[count].scratch < 0) error = ERR_CREATEFILE;
+    }
+
+  /*the server only starts with every worker; the ones already running*/
+  /*leave accept once the socket is shut down*/
+  started = 0;
+  while ((error == NO_ERROR) && (started < threads))
+    {
+      if (pthread_create(&workers[started].thread, NULL, serve_worker, &workers[started]) == 0) started++;
+      else
+	{
+	  error = ERR_MEMORY;
+	  shutdown(srv.listener, SHUT_RDWR);
+	}
+    }
+  for (count = 0; count < started; count++) pthread_join(workers[count].thread, NULL);
+
+  for (count = 0; (workers != NULL) && (count < threads); count++)
+    if (workers[count].scratch >= 0) close(workers[count].scratch);
+  free(workers);
+  pthread_mutex_destroy(&srv.lock);
+  close(srv.listener);
+  unlink(path);
+  return error;
+}
+
+/*serve_request runs the script read from conn until the client shuts down*/
+/*its side, then ends the reply with a line giving the milliseconds from*/
+/*accepting to answering and OK or the error message. A script that takes*/
+/*longer than SERVE_TIMEOUT to arrive or is longer than SERVE_SCRIPT_MAX*/
+/*stops with a read error.*/
+
+int serve_request (server_ptr srv, scene_ptr sc, int conn)
+{
+  script input;
+  run_stats st;
+  struct iovec iov;
+  struct timeval wait;
+  char done[160];
+  double start;
+  long long served;
+  int error, fd;
+
+  start = stats_clock();
+  sc->reply = conn;
+
+  /*a client that stops reading its replies can't hold the worker either*/
+  wait.tv_sec = SERVE_TIMEOUT;
+  wait.tv_usec = 0;
+  setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &wait, sizeof(wait));
+  if (srv->options.stats)
+    {
+      memset(&st, 0, sizeof(run_stats));
+      sc->stats = &st;
+      sc->cv.drawn = st.pixels;
+    }
+  fd = dup(conn);
+  if (fd < 0) error = ERR_READ;
+  else error = script_attach(&input, fd);
+  if (error == NO_ERROR)
+    {
+      /*a client that never finishes its script can't hold the worker*/
+      input.deadline = start + SERVE_TIMEOUT;
+      input.limit = SERVE_SCRIPT_MAX;
+      error = interpret (&input, sc);
+      script_close (&input);
+    }
+
+  iov.iov_base = done;
+  iov.iov_len = snprintf(done, sizeof(done), "DONE %.3f ms %s\n", (stats_clock() - start) * 1000, (error == NO_ERROR) ? "OK" : error_message(error));
+  write_parts (conn, &iov, 1);
+
+  pthread_mutex_lock(&srv->lock);
+  served = ++srv->served;
+  pthread_mutex_unlock(&srv->lock);
+  if (sc->stats != NULL)
+    {
+      snprintf(done, sizeof(done), "request %lld", served);
+      st.seconds[STAGE_PARSE] = stats_clock() - start - st.seconds[STAGE_DISPATCH];
+      st.seconds[STAGE_DISPATCH] -= st.seconds[STAGE_RENDER] + st.seconds[STAGE_ENCODE];
+      print_stats (done, &st, sc, srv->options.stats);
+    }
+  sc->reply = -1;
+  sc->stats = NULL;
+  sc->cv.drawn = NULL;
+  return error;
+}
+
+/*send_reply tells the client of a --serve request about a SAVE: the path*/
+/*of the file written, or for SAVE - the size of the picture in the scratch*/
+/*file followed by the picture itself*/
+
+int send_reply (scene_ptr sc, const char *path)
+{
+  struct iovec iov[2];
+  char line[PATH_MAX + 16];
+  void *map = NULL;
+  off_t size = 0;
+  int error;
+
+  if (strcmp(path, "-") != 0)
+    {
+      iov[0].iov_base = line;
+      iov[0].iov_len = snprintf(line, sizeof(line), "SAVED %s\n", path);
+      return write_parts(sc->reply, iov, 1);
+    }
+  size = lseek(sc->scratch, 0, SEEK_END);
+  if (size <= 0) return ERR_WRITE;
+  map = mmap(NULL, size, PROT_READ, MAP_SHARED, sc->scratch, 0);
+  if (map == MAP_FAILED) return ERR_WRITE;
+  iov[0].iov_base = line;
+  iov[0].iov_len = snprintf(line, sizeof(line), "IMAGE %lld\n", (long long) size);
+  iov[1].iov_base = map;
+  iov[1].iov_len = size;
+  error = write_parts(sc->reply, iov, 2);
+  munmap(map, size);
+  return error;
+}
+
+/*The following functions are the library interface declared in idraw.h.*/
+/*They return IDRAW_OK where the interpreter has NO_ERROR.*/
+
+/*idraw_create makes a context with an empty canvas of width by height*/
+
+idraw_context *idraw_create (int width, int height)
+{
+  idraw_context *ctx;
+
+  ctx = malloc(sizeof(idraw_context));
+  if (ctx == NULL) return NULL;
+  initialize_scene (&ctx->sc);
+  ctx->sc.options.threads = 1;
+  ctx->lines = 0;
+  ctx->error_line = 0;
+  if (resize_canvas(&ctx->sc.cv, width, height) != NO_ERROR)
+    {
+      release_scene (&ctx->sc);
+      free(ctx);
+      return NULL;
+    }
+  return ctx;
+}
+
+/*idraw_destroy frees a context*/
+
+void idraw_destroy (idraw_context *ctx)
+{
+  if (ctx == NULL) return;
+  release_scene (&ctx->sc);
+  free(ctx);
+}
+
+/*idraw_set_threads sets the threads that draw the tiles of a render*/
+
+void idraw_set_threads (idraw_context *ctx, int threads)
+{
+  ctx->sc.options.threads = (threads > 0) ? threads : 1;
+}
+
+/*idraw_feed_line runs one command line*/
+
+int idraw_feed_line (idraw_context *ctx, const char *line, size_t length)
+{
+  command cmd;
+  int error = NO_ERROR;
+
+  ctx->lines++;
+  if (tokenize(line, length, &cmd) > 0) error = process (&cmd, &ctx->sc);
+  if (error == NO_ERROR) return IDRAW_OK;
+  ctx->error_line = ctx->lines;
+  return error;
+}
+
+/*idraw_feed_script runs the lines of text until one fails*/
+
+int idraw_feed_script (idraw_context *ctx, const char *text, size_t length)
+{
+  const char *end = text + length, *newline;
+  int error = IDRAW_OK;
+
+  while ((error == IDRAW_OK) && (text < end))
+    {
+      newline = memchr(text, '\n', end - text);
+      if (newline == NULL) newline = end;
+      error = idraw_feed_line (ctx, text, newline - text);
+      text = newline + 1;
+    }
+  return error;
+}
+
+/*idraw_error_line gives the line that last failed, or 0*/
+
+int idraw_error_line (idraw_context *ctx)
+{
+  return ctx->error_line;
+}
+
+/*idraw_get_size gives the current size of the canvas*/
+
+void idraw_get_size (idraw_context *ctx, int *width, int *height)
+{
+  *width = ctx->sc.cv.width;
+  *height = ctx->sc.cv.height;
+}
+
+/*idraw_image_size gives the bytes of a picture in format*/
+
+size_t idraw_image_size (idraw_context *ctx, int format)
+{
+  canvas_ptr cv = &ctx->sc.cv;
+
+  if (format == IDRAW_PIXELS) return (size_t) cv->width * cv->height;
+  if (format == IDRAW_BMP) return BMP_HEADER + (size_t) cv->stride * cv->height;
+  return 0;
+}
+
+/*idraw_render draws the scene the way a SAVE does and copies the picture*/
+/*into buffer. The canvas rows are kept bottom-up and padded, so the pixels*/
+/*format turns them over row by row.*/
+
+int idraw_render (idraw_context *ctx, int format, void *buffer, size_t size)
+{
+  scene_ptr sc = &ctx->sc;
+  canvas_ptr cv = &sc->cv;
+  unsigned char *out = buffer;
+  size_t needed;
+  int error, partial, row;
+
+  needed = idraw_image_size(ctx, format);
+  if ((needed == 0) || (size < needed)) return ERR_BUFFER;
+  if (!pool_compact(&sc->points) || !pool_compact(&sc->lines) || !pool_compact(&sc->boxes) || !pool_compact(&sc->circles)) return ERR_MEMORY;
+  error = draw_scene (sc, &partial);
+  if (error != NO_ERROR) return error;
+  cv->dirty_count = 0;
+  cv->dirty_all = 0;
+
+  if (format == IDRAW_BMP)
+    {
+      memcpy(out, cv->header, BMP_HEADER);
+      memcpy(out + BMP_HEADER, cv->pixels, (size_t) cv->stride * cv->height);
+    }
+  else
+    {
+      for (row = 0; row < cv->height; row++)
+	memcpy(out + (size_t) row * cv->width, &PIXEL(cv, 0, cv->height - 1 - row), cv->width);
+    }
+  return IDRAW_OK;
+}
+
+/*idraw_error_message gives the message of an error code*/
+
+const char *idraw_error_message (int error)
+{
+  return (error == IDRAW_OK) ? "OK" : error_message(error);
+}
+
+/*process_counted runs a command through process for --stats, counting it*/
+/*under the operation it comes down to and timing it*/
+
+static int process_counted (command_ptr cmd, scene_ptr sc)
+{
+  run_stats_ptr st = sc->stats;
+  double start;
+  int error;
+
+  if (field_is(&cmd->word[0], "MOVE")) st->moves++;
+  else if (field_is(&cmd->word[0], "DELT")) st->commands[OP_DELETE]++;
+  else if (graph_word(&cmd->word[0])) st->commands[OP_GRAPH]++;
+  else if (field_is(&cmd->word[0], "SAVE")) st->commands[OP_SAVE]++;
+  else if (field_is(&cmd->word[0], "SIZE")) st->commands[OP_SIZE]++;
+  else if (strchr("PLBC", cmd->word[0].text[0]) != NULL) st->commands[OP_POINT + (strchr("PLBC", cmd->word[0].text[0]) - "PLBC")]++;
+  else st->commands[OP_END]++;
+
+  start = stats_clock();
+  error = process (cmd, sc);
+  st->seconds[STAGE_DISPATCH] += stats_clock() - start;
+  return error;
+}
+
+/*interpret runs the commands of the script in turn until one fails*/
+
+int interpret (script_ptr input, scene_ptr sc)
+{
+  command cmd;
+  char *line;
+  size_t length;
+  int error = NO_ERROR, status;
+
+  while ((status = script_line(input, &line, &length)) > 0)
+    {
+      if (sc->stats != NULL) sc->stats->lines++;
+      if (tokenize(line, length, &cmd) == 0) continue;
+      if (sc->stats != NULL) error = process_counted (&cmd, sc);
+      else error = process (&cmd, sc);
+      if (error != NO_ERROR) return error;
+    }
+  return (status < 0) ? ERR_READ : error;
+}
+
+/*The following functions initialize the subjects that will contain*/
+/*that are going to be created in Iguhit*/ 
+
+void initialize_pts (pts_ptr ps)
+{
+  pool_init(ps, 2);
+}
+
+void initialize_ln (ln_ptr ls)
+{
+  pool_init(ls, 4);
+}
+
+void initialize_bx (bx_ptr bs)
+{
+  pool_init(bs, 4);
+}
+
+void initialize_cir (cir_ptr cs)
+{
+  pool_init(cs, 3);
+}
+
+void initialize_graph (graph_ptr g)
+{
+  g->low = NULL;
+  g->high = NULL;
+  g->count = 0;
+  g->id = 0;
+  g->color = 0;
+  g->scale = 1.0f;
+  g->offset = 0.0f;
+}
+
+/*initialize_graphs prepares an empty set of series*/
+
+void initialize_graphs (graph_set_ptr gs)
+{
+  gs->series = NULL;
+  gs->count = 0;
+  gs->capacity = 0;
+}
+
+/*release_graphs frees every series of a set*/
+
+void release_graphs (graph_set_ptr gs)
+{
+  int count;
+
+  for (count = 0; count < gs->count; count++) free (gs->series[count].low);
+  free (gs->series);
+  initialize_graphs (gs);
+}
+
+void initialize_canvas (canvas_ptr cv)
+{
+  cv->pixels = NULL;
+  cv->fill = choose_span_fill();
+  cv->drawn = NULL;
+  resize_canvas(cv, PIXEL_MAX, PIXEL_MAX);
+}
+
+/*initialize_scene prepares an empty scene on the default canvas*/
+
+void initialize_scene (scene_ptr sc)
+{
+  initialize_pts (&sc->points);
+  initialize_ln (&sc->lines);
+  initialize_bx (&sc->boxes);
+  initialize_cir (&sc->circles);
+  initialize_graphs (&sc->graphs);
+  initialize_canvas (&sc->cv);
+  memset (&sc->options, 0, sizeof(settings));
+  sc->anim = NULL;
+  sc->stats = NULL;
+  sc->reply = -1;
+  sc->scratch = -1;
+}
+
+/*release_scene frees the memory held by a scene*/
+
+void release_scene (scene_ptr sc)
+{
+  pool_free (&sc->points);
+  pool_free (&sc->lines);
+  pool_free (&sc->boxes);
+  pool_free (&sc->circles);
+  release_graphs (&sc->graphs);
+  free (sc->cv.pixels);
+  sc->cv.pixels = NULL;
+}
+
+/*reset_scene empties a scene for the next script while keeping the memory*/
+/*of its pools and, when the size is the same, its pixels, which are set to*/
+/*the background so that the first SAVE only draws what the script adds*/
+
+void reset_scene (scene_ptr sc, int width, int height)
+{
+  canvas_ptr cv = &sc->cv;
+
+  pool_clear (&sc->points);
+  pool_clear (&sc->lines);
+  pool_clear (&sc->boxes);
+  pool_clear (&sc->circles);
+  release_graphs (&sc->graphs);
+  if ((cv->width != width) || (cv->height != height))
+    {
+      resize_canvas (cv, width, height);
+      return;
+    }
+  if (cv->pixels != NULL) memset(cv->pixels, 0, (size_t) cv->stride * cv->height);
+  cv->dirty_count = 0;
+  cv->dirty_all = 0;
+}
+
+/*resize_canvas changes the size of the canvas. The pixels are dropped and*/
+/*allocated again by the next SAVE.*/
+
+int resize_canvas (canvas_ptr cv, int width, int height)
+{
+  if ((width < 1) || (height < 1) || (width > CANVAS_MAX) || (height > CANVAS_MAX)) return ERR_SIZE;
+
+  free(cv->pixels);
+  cv->pixels = NULL;
+  cv->width = width;
+  cv->height = height;
+  cv->stride = (width + 3) & ~3;
+  cv->clip_x0 = 0;
+  cv->clip_y0 = 0;
+  cv->clip_x1 = width;
+  cv->clip_y1 = height;
+  cv->dirty_count = 0;
+  cv->dirty_all = 0;
+  BMPheader(cv);
+  return NO_ERROR;
+}
+
+/*clear_canvas allocates the pixels of the canvas if needed and sets them*/
+/*all to the background color*/
+
+int clear_canvas (canvas_ptr cv)
+{
+  if (cv->pixels == NULL)
+    {
+      cv->pixels = malloc((size_t) cv->stride * cv->height);
+      if (cv->pixels == NULL) return ERR_MEMORY;
+    }
+  memset(cv->pixels, 0, (size_t) cv->stride * cv->height);
+  return NO_ERROR;
+}
+
+/*radius_max gives the largest radius allowed for a circle. It is 89 on the*/
+/*default canvas and grows with the larger side of the canvas.*/
+
+int radius_max (canvas_ptr cv)
+{
+  int side;
+
+  side = (cv->width > cv->height) ? cv->width : cv->height;
+  return (int) (((long) (RADIUS_MAX - 1) * side) / PIXEL_MAX);
+}
+
+/*pool_init prepares an empty shape pool with the given number of coordinates*/
+
+void pool_init (pool_ptr p, int fields)
+{
+  memset(p, 0, sizeof(shape_pool));
+  p->fields = fields;
+  p->ordered = 1;
+}
+
+/*pool_free releases the memory held by a shape pool*/
+
+void pool_free (pool_ptr p)
+{
+  int field;
+
+  for (field = 0; field < POOL_FIELDS; field++) free(p->coord[field]);
+  free(p->id);
+  free(p->color);
+  free(p->occupied);
+  free(p->index.keys);
+  free(p->index.slots);
+  grid_free(&p->grid);
+  pool_init(p, p->fields);
+}
+
+/*pool_clear empties a shape pool, keeping its arrays, its index and its*/
+/*grid cells for the shapes to come*/
+
+void pool_clear (pool_ptr p)
+{
+  int cell;
+
+  if (p->capacity > 0) memset(p->occupied, 0, (p->capacity + 31) / 32 * sizeof(unsigned int));
+  if (p->index.size > 0) memset(p->index.keys, 0xff, p->index.size * sizeof(int));
+  p->index.used = 0;
+  if (p->grid.cells != NULL)
+    {
+      for (cell = 0; cell <= p->grid.columns * p->grid.rows; cell++) p->grid.cells[cell].count = 0;
+    }
+  p->count = 0;
+  p->live = 0;
+  p->max_id = 0;
+  p->ordered = 1;
+}
+
+/*hash_id scatters an object number over the buckets of an id_index*/
+
+static unsigned int hash_id (int id, int size)
+{
+  unsigned int h;
+
+  h = (unsigned int) id * 0x9E3779B1u;
+  h ^= h >> 16;
+  return h & (unsigned int) (size - 1);
+}
+
+/*index_put stores the slot of an object number, growing the index so that*/
+/*it is never more than half full. Returns 0 if memory ran out.*/
+
+static int index_put (id_index_ptr ix, int id, int slot)
+{
+  int *keys, *slots, size, count;
+  unsigned int h;
+
+  if (2 * (ix->used + 1) > ix->size)
+    {
+      size = ix->size ? 2 * ix->size : 2 * POOL_INITIAL;
+      keys = malloc(size * sizeof(int));
+      slots = malloc(size * sizeof(int));
+      if ((keys == NULL) || (slots == NULL))
+	{
+	  free(keys);
+	  free(slots);
+	  return 0;
+	}
+      for (count = 0; count < size; count++) keys[count] = -1;
+      for (count = 0; count < ix->size; count++)
+	{
+	  if (ix->keys[count] < 0) continue;
+	  h = hash_id(ix->keys[count], size);
+	  while (keys[h] >= 0) h = (h + 1) & (size - 1);
+	  keys[h] = ix->keys[count];
+	  slots[h] = ix->slots[count];
+	}
+      free(ix->keys);
+      free(ix->slots);
+      ix->keys = keys;
+      ix->slots = slots;
+      ix->size = size;
+    }
+
+  h = hash_id(id, ix->size);
+  while ((ix->keys[h] >= 0) && (ix->keys[h] != id)) h = (h + 1) & (ix->size - 1);
+  if (ix->keys[h] < 0) ix->used++;
+  ix->keys[h] = id;
+  ix->slots[h] = slot;
+  return 1;
+}
+
+/*index_get returns the slot of an object number or -1 if it has none*/
+
+static int index_get (id_index_ptr ix, int id)
+{
+  unsigned int h;
+
+  if (ix->size == 0) return -1;
+  h = hash_id(id, ix->size);
+  while (ix->keys[h] >= 0)
+    {
+      if (ix->keys[h] == id) return ix->slots[h];
+      h = (h + 1) & (ix->size - 1);
+    }
+  return -1;
+}
+
+/*index_del removes an object number, shifting back the entries that follow*/
+/*it in the probe sequence so that no tombstones are needed*/
+
+static void index_del (id_index_ptr ix, int id)
+{
+  unsigned int h, next, home, mask;
+
+  if (ix->size == 0) return;
+  mask = (unsigned int) (ix->size - 1);
+  h = hash_id(id, ix->size);
+  while (ix->keys[h] != id)
+    {
+      if (ix->keys[h] < 0) return;
+      h = (h + 1) & mask;
+    }
+
+  next = h;
+  for (;;)
+    {
+      next = (next + 1) & mask;
+      if (ix->keys[next] < 0) break;
+      home = hash_id(ix->keys[next], ix->size);
+      /*move the entry back unless its home lies cyclically in (h, next]*/
+      if (((next - home) & mask) >= ((next - h) & mask))
+	{
+	  ix->keys[h] = ix->keys[next];
+	  ix->slots[h] = ix->slots[next];
+	  h = next;
+	}
+    }
+  ix->keys[h] = -1;
+  ix->used--;
+}
+
+/*pool_grow doubles the slot arrays of a pool. Returns 0 if memory ran out.*/
+
+static int pool_grow (pool_ptr p)
+{
+  int field, capacity, words;
+  void *mem;
+
+  capacity = p->capacity ? 2 * p->capacity : POOL_INITIAL;
+  words = (capacity + 31) / 32;
+  for (field = 0; field < p->fields; field++)
+    {
+      mem = realloc(p->coord[field], capacity * sizeof(int));
+      if (mem == NULL) return 0;
+      p->coord[field] = mem;
+    }
+  mem = realloc(p->id, capacity * sizeof(int));
+  if (mem == NULL) return 0;
+  p->id = mem;
+  mem = realloc(p->color, capacity);
+  if (mem == NULL) return 0;
+  p->color = mem;
+  mem = realloc(p->occupied, words * sizeof(unsigned int));
+  if (mem == NULL) return 0;
+  p->occupied = mem;
+  memset(p->occupied + (p->capacity + 31) / 32, 0, (words - (p->capacity + 31) / 32) * sizeof(unsigned int));
+  p->capacity = capacity;
+  return 1;
+}
+
+/*pool_find returns the slot of a live object or -1 if there is none*/
+
+int pool_find (pool_ptr p, int id)
+{
+  return index_get(&p->index, id);
+}
+
+/*pool_insert returns the slot of an object, handing out a new slot if the*/
+/*object does not exist yet. Returns -1 if memory ran out.*/
+
+int pool_insert (pool_ptr p, int id)
+{
+  int slot;
+
+  slot = index_get(&p->index, id);
+  if (slot >= 0) return slot;
+
+  if ((p->count == p->capacity) && (p->live < p->count / 2)) pool_compact(p);
+  if ((p->count == p->capacity) && !pool_grow(p)) return -1;
+
+  slot = p->count;
+  if (!index_put(&p->index, id, slot)) return -1;
+  p->count++;
+  p->live++;
+  p->id[slot] = id;
+  p->occupied[slot / 32] |= 1u << (slot % 32);
+  if (id < p->max_id) p->ordered = 0;
+  else p->max_id = id;
+  return slot;
+}
+
+/*pool_remove deletes an object by clearing its occupied bit*/
+
+void pool_remove (pool_ptr p, int id)
+{
+  int slot;
+
+  slot = index_get(&p->index, id);
+  if (slot < 0) return;
+  index_del(&p->index, id);
+  p->occupied[slot / 32] &= ~(1u << (slot % 32));
+  p->live--;
+}
+
+/*compare_slots orders (object number, slot) pairs by object number*/
+
+static int compare_slots (const void *a, const void *b)
+{
+  int ida = ((const int *) a)[0], idb = ((const int *) b)[0];
+
+  return (ida > idb) - (ida < idb);
+}
+
+/*pool_compact packs the live slots of a pool to the front, in increasing*/
+/*object number, so that drawing walks them in the same order as the object*/
+/*numbers. Returns 0 if memory ran out.*/
+
+int pool_compact (pool_ptr p)
+{
+  int *order, *tmp, field, slot, count, words;
+  char *ctmp;
+
+  if ((p->live == p->count) && p->ordered) return 1;
+
+  order = malloc(2 * (p->live + 1) * sizeof(int));
+  tmp = malloc((p->live + 1) * sizeof(int));
+  ctmp = malloc(p->live + 1);
+  if ((order == NULL) || (tmp == NULL) || (ctmp == NULL))
+    {
+      free(order);
+      free(tmp);
+      free(ctmp);
+      return 0;
+    }
+
+  /*order holds (object number, old slot) pairs*/
+  count = 0;
+  for (slot = pool_next(p, 0); slot >= 0; slot = pool_next(p, slot + 1))
+    {
+      order[2 * count] = p->id[slot];
+      order[2 * count + 1] = slot;
+      count++;
+    }
+  if (!p->ordered) qsort(order, count, 2 * sizeof(int), compare_slots);
+
+  for (field = 0; field < p->fields; field++)
+    {
+      for (slot = 0; slot < count; slot++) tmp[slot] = p->coord[field][order[2 * slot + 1]];
+      memcpy(p->coord[field], tmp, count * sizeof(int));
+    }
+  for (slot = 0; slot < count; slot++) ctmp[slot] = p->color[order[2 * slot + 1]];
+  memcpy(p->color, ctmp, count);
+
+  words = (p->capacity + 31) / 32;
+  memset(p->occupied, 0, words * sizeof(unsigned int));
+  for (slot = 0; slot < count; slot++)
+    {
+      p->id[slot] = order[2 * slot];
+      p->occupied[slot / 32] |= 1u << (slot % 32);
+      index_put(&p->index, p->id[slot], slot);
+    }
+
+  p->count = count;
+  p->live = count;
+  p->max_id = count ? p->id[count - 1] : 0;
+  p->ordered = 1;
+  free(order);
+  free(tmp);
+  free(ctmp);
+  return 1;
+}
+
+/*pool_next returns the first live slot at or after slot, or -1 if there is*/
+/*none. Whole words of the bitset are skipped when they hold no live slot.*/
+
+int pool_next (pool_ptr p, int slot)
+{
+  unsigned int word;
+
+  while (slot < p->count)
+    {
+      word = p->occupied[slot / 32] >> (slot % 32);
+      if (word == 0)
+	{
+	  slot = (slot / 32 + 1) * 32;
+	  continue;
+	}
+      while (!(word & 1))
+	{
+	  word >>= 1;
+	  slot++;
+	}
+      return (slot < p->count) ? slot : -1;
+    }
+  return -1;
+}
+
+/*script_open opens filename, or stdin for "-", for reading*/
+
+int script_open (script_ptr s, const char *filename)
+{
+  int fd;
+
+  if (strcmp(filename, "-") == 0) fd = dup(STDIN_FILENO);
+  else fd = open(filename, O_RDONLY);
+  if (fd < 0) return ERR_CREATEFILE;
+  return script_attach(s, fd);
+}
+
+/*script_attach reads the script from fd, which it takes over, mapping it*/
+/*when it is a regular file*/
+
+int script_attach (script_ptr s, int fd)
+{
+  struct stat info;
+  void *map;
+
+  s->fd = fd;
+  s->data = NULL;
+  s->size = 0;
+  s->pos = 0;
+  s->capacity = 0;
+  s->eof = 0;
+  s->taken = 0;
+  s->limit = 0;
+  s->deadline = 0;
+  if ((fstat(s->fd, &info) == 0) && S_ISREG(info.st_mode))
+    {
+      if (info.st_size == 0)
+	{
+	  s->eof = 1;
+	  return NO_ERROR;
+	}
+      map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, s->fd, 0);
+      if (map != MAP_FAILED)
+	{
+	  madvise(map, info.st_size, MADV_SEQUENTIAL);
+	  s->data = map;
+	  s->size = info.st_size;
+	  s->eof = 1;
+	  return NO_ERROR;
+	}
+    }
+
+  s->data = malloc(SCRIPT_BLOCK);
+  if (s->data == NULL)
+    {
+      close(s->fd);
+      return ERR_MEMORY;
+    }
+  s->capacity = SCRIPT_BLOCK;
+  return NO_ERROR;
+}
+
+/*script_wait waits until the script can be read or its deadline passes.*/
+/*It returns 1 when it can be read and 0 or -1 when it can't.*/
+
+static int script_wait (script_ptr s)
+{
+  struct pollfd ready;
+  double left;
+  int got;
+
+  ready.fd = s->fd;
+  ready.events = POLLIN;
+  do
+    {
+      left = s->deadline - stats_clock();
+      if (left <= 0) return 0;
+      got = poll(&ready, 1, (int) (left * 1000) + 1);
+    }
+  while ((got < 0) && (errno == EINTR));
+  return got;
+}
+
+/*script_line hands out the next line without its newline. It returns 1 for*/
+/*a line, 0 at the end of the script and -1 if the script can't be read. The*/
+/*line stays valid until the next call.*/
+
+int script_line (script_ptr s, char **line, size_t *length)
+{
+  char *end, *grown;
+  size_t scanned = 0;
+  ssize_t got;
+
+  for (;;)
+    {
+      end = NULL;
+      if (s->pos + scanned < s->size)
+	end = memchr(s->data + s->pos + scanned, '\n', s->size - s->pos - scanned);
+      if (end != NULL)
+	{
+	  *line = s->data + s->pos;
+	  *length = end - *line;
+	  s->pos += *length + 1;
+	  return 1;
+	}
+      if (s->eof)
+	{
+	  if (s->pos == s->size) return 0;
+	  *line = s->data + s->pos;
+	  *length = s->size - s->pos;
+	  s->pos = s->size;
+	  return 1;
+	}
+
+      /*Keep the unfinished line and read more after it*/
+      scanned = s->size - s->pos;
+      memmove(s->data, s->data + s->pos, scanned);
+      s->size = scanned;
+      s->pos = 0;
+      if (s->size == s->capacity)
+	{
+	  grown = realloc(s->data, s->capacity * 2);
+	  if (grown == NULL) return -1;
+	  s->data = grown;
+	  s->capacity *= 2;
+	}
+      do
+	{
+	  /*a script with a deadline is only read once it has data*/
+	  if ((s->deadline > 0) && (script_wait(s) <= 0)) return -1;
+	  got = read(s->fd, s->data + s->size, s->capacity - s->size);
+	}
+      while ((got < 0) && (errno == EINTR));
+      if (got < 0) return -1;
+      if (got == 0) s->eof = 1;
+      s->size += got;
+      s->taken += got;
+      if ((s->limit > 0) && (s->taken > s->limit)) return -1;
+    }
+}
+
+/*script_close unmaps or frees the script and closes its file*/
+
+void script_close (script_ptr s)
+{
+  if (s->capacity == 0)
+    {
+      if (s->data != NULL) munmap(s->data, s->size);
+    }
+  else free(s->data);
+  close(s->fd);
+}
+
+/*hash_bytes folds size bytes of data into hash with 64-bit FNV-1a, eight*/
+/*bytes at a time*/
+
+unsigned long long hash_bytes (const void *data, size_t size, unsigned long long hash)
+{
+  const unsigned char *bytes = data;
+  unsigned long long word;
+  size_t count;
+
+  for (count = 0; count + 8 <= size; count += 8)
+    {
+      memcpy(&word, bytes + count, 8);
+      hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+  for (; count < size; count++) hash = (hash ^ bytes[count]) * 0x100000001b3ULL;
+  return hash;
+}
+
+/*cache_name returns the name of the compiled form of filename*/
+
+char *cache_name (const char *filename)
+{
+  char *name;
+
+  name = malloc(strlen(filename) + sizeof(CACHE_SUFFIX));
+  if (name != NULL)
+    {
+      strcpy(name, filename);
+      strcat(name, CACHE_SUFFIX);
+    }
+  return name;
+}
+
+/*script_key hashes the script text together with the starting canvas size,*/
+/*since the checks made at compile time depend on both*/
+
+static unsigned long long script_key (script_ptr input, canvas_ptr cv)
+{
+  int size[2];
+
+  size[0] = cv->width;
+  size[1] = cv->height;
+  return hash_bytes(input->data, input->size, hash_bytes(size, sizeof(size), 0xcbf29ce484222325ULL));
+}
+
+/*reserve_ops makes room for count more ints at the end of stream*/
+
+static int *reserve_ops (op_stream_ptr stream, size_t count)
+{
+  int *ops;
+  size_t capacity;
+
+  if (stream->count + count > stream->capacity)
+    {
+      capacity = (stream->capacity == 0) ? 4096 : stream->capacity;
+      while (capacity < stream->count + count) capacity *= 2;
+      ops = realloc(stream->ops, capacity * sizeof(int));
+      if (ops == NULL) return NULL;
+      stream->ops = ops;
+      stream->capacity = capacity;
+    }
+  ops = stream->ops + stream->count;
+  stream->count += count;
+  return ops;
+}
+
+/*emit_path adds an operation that takes a number and a path*/
+
+static int emit_path (op_stream_ptr stream, int op, int number, field_ptr f)
+{
+  int *ops, words;
+
+  words = (f->length + 1 + sizeof(int) - 1) / sizeof(int);
+  ops = reserve_ops(stream, 3 + words);
+  if (ops == NULL) return ERR_MEMORY;
+  ops[0] = op;
+  ops[1] = number;
+  ops[2] = words;
+  ops[2 + words] = 0;
+  memcpy(ops + 3, f->text, f->length);
+  ((char *) (ops + 3))[f->length] = '\0';
+  return NO_ERROR;
+}
+
+/*emit_shape adds the operation that sets a shape to what its pool holds*/
+
+static int emit_shape (op_stream_ptr stream, int op, pool_ptr p, int id)
+{
+  int *ops, slot, count;
+
+  slot = pool_find(p, id);
+  if (slot < 0) return NO_ERROR;
+  ops = reserve_ops(stream, 3 + p->fields);
+  if (ops == NULL) return ERR_MEMORY;
+  ops[0] = op;
+  ops[1] = id;
+  for (count = 0; count < p->fields; count++) ops[2 + count] = p->coord[count][slot];
+  ops[2 + p->fields] = p->color[slot];
+  return NO_ERROR;
+}
+
+/*shape_pool_of returns the pool of the shape named by letter, or NULL*/
+
+static pool_ptr shape_pool_of (scene_ptr sc, char letter, int *op)
+{
+  switch (letter)
+    {
+    case 'P':
+      *op = OP_POINT;
+      return &sc->points;
+
+    case 'L':
+      *op = OP_LINE;
+      return &sc->lines;
+
+    case 'B':
+      *op = OP_BOX;
+      return &sc->boxes;
+
+    case 'C':
+      *op = OP_CIRCLE;
+      return &sc->circles;
+    }
+  return NULL;
+}
+
+/*compile_command checks one command against the scene the way process does*/
+/*and adds the operation it comes down to. SAVE, GRAP and Gn only record*/
+/*their file, the rest run through process on a scene that is never drawn, so a*/
+/*MOVE is stored as the shape's new coordinates and a MOVE of a missing*/
+/*shape is dropped.*/
+
+int compile_command (command_ptr cmd, scene_ptr sc, op_stream_ptr stream)
+{
+  field_ptr name;
+  pool_ptr pool;
+  int *ops, error, colnum, op, id;
+  float scale, offset;
+
+  if (field_is(&cmd->word[0], "SAVE"))
+    {
+      if ((cmd->word[1].length == 0) || (cmd->word[1].length >= PATH_MAX)) return ERR_CREATEFILE;
+      return emit_path(stream, OP_SAVE, save_mode(&cmd->word[2]), &cmd->word[1]);
+    }
+
+  if (graph_word(&cmd->word[0]))
+    {
+      id = field_is(&cmd->word[0], "GRAP") ? 0 : field_number(&cmd->word[0]);
+      if ((id < 1) && !field_is(&cmd->word[0], "GRAP")) return ERR_SERIES;
+      colnum = cmd->word[2].value;
+      if ((colnum < 0) || (colnum > 4)) colnum = 1;
+      if (cmd->word[1].length >= PATH_MAX) cmd->word[1].length = 0;
+      error = emit_path(stream, OP_GRAPH, colnum, &cmd->word[1]);
+      if (error != NO_ERROR) return error;
+      ops = reserve_ops(stream, 3);
+      if (ops == NULL) return ERR_MEMORY;
+      scale = field_float(&cmd->word[3], 1.0f);
+      offset = field_float(&cmd->word[4], 0.0f);
+      ops[0] = id;
+      memcpy(ops + 1, &scale, sizeof(float));
+      memcpy(ops + 2, &offset, sizeof(float));
+      return NO_ERROR;
+    }
+
+  error = process(cmd, sc);
+  if (error != NO_ERROR) return error;
+
+  if (field_is(&cmd->word[0], "SIZE"))
+    {
+      ops = reserve_ops(stream, 3);
+      if (ops == NULL) return ERR_MEMORY;
+      ops[0] = OP_SIZE;
+      ops[1] = sc->cv.width;
+      ops[2] = sc->cv.height;
+      return NO_ERROR;
+    }
+
+  name = &cmd->word[0];
+  if (field_is(name, "MOVE") || field_is(name, "DELT")) name = &cmd->word[1];
+  if (field_is(&cmd->word[0], "DELT") && (name->text[0] == 'G') && (field_number(name) > 0))
+    {
+      ops = reserve_ops(stream, 3);
+      if (ops == NULL) return ERR_MEMORY;
+      ops[0] = OP_DELETE;
+      ops[1] = 'G';
+      ops[2] = field_number(name) - 1;
+      return NO_ERROR;
+    }
+  pool = shape_pool_of(sc, name->text[0], &op);
+  if ((pool == NULL) || (field_number(name) < 1)) return NO_ERROR;
+
+  if (field_is(&cmd->word[0], "DELT"))
+    {
+      ops = reserve_ops(stream, 3);
+      if (ops == NULL) return ERR_MEMORY;
+      ops[0] = OP_DELETE;
+      ops[1] = name->text[0];
+      ops[2] = field_number(name) - 1;
+      return NO_ERROR;
+    }
+  return emit_shape(stream, op, pool, field_number(name) - 1);
+}
+
+/*compile_script checks the whole script once and writes its compiled form*/
+/*next to it. A script that stops on an error compiles to the operations*/
+/*before it followed by the error, so running it prints the same message.*/
+/*It returns -1 when the compiled form can't be written, so the script is*/
+/*interpreted instead.*/
+
+static unsigned int compile_serial;
+
+int compile_script (script_ptr input, const char *filename, scene_ptr sc)
+{
+  op_stream stream = { NULL, 0, 0 };
+  struct iovec iov[2];
+  unsigned long long key, check;
+  command cmd;
+  char *line, *name, *temp = NULL;
+  size_t length;
+  unsigned int header[CACHE_HEADER];
+  int *ops, error = NO_ERROR, status, fd = -1, tries;
+
+  if (input->capacity != 0) return ERR_COMPILE;
+  key = script_key(input, &sc->cv);
+
+  while ((status = script_line(input, &line, &length)) > 0)
+    {
+      if (tokenize(line, length, &cmd) == 0) continue;
+      error = compile_command(&cmd, sc, &stream);
+      if (error == ERR_MEMORY) break;
+      if (error != NO_ERROR)
+	{
+	  ops = reserve_ops(&stream, 2);
+	  if (ops == NULL) error = ERR_MEMORY;
+	  else
+	    {
+	      ops[0] = OP_ERROR;
+	      ops[1] = error;
+	      error = NO_ERROR;
+	    }
+	  break;
+	}
+    }
+  if (status < 0) error = ERR_READ;
+  if ((error == NO_ERROR) && ((ops = reserve_ops(&stream, 1)) != NULL)) ops[0] = OP_END;
+  else if (error == NO_ERROR) error = ERR_MEMORY;
+
+  name = cache_name(filename);
+  if (name != NULL) temp = malloc(strlen(name) + 32);
+  if ((error == NO_ERROR) && (temp == NULL)) error = ERR_MEMORY;
+
+  if (error == NO_ERROR)
+    {
+      /*write a private file and rename it, so readers never see half of it*/
+      check = hash_bytes(stream.ops, stream.count * sizeof(int), 0xcbf29ce484222325ULL);
+      header[0] = CACHE_MAGIC;
+      header[1] = CACHE_VERSION;
+      header[2] = (unsigned int) (key & 0xffffffffu);
+      header[3] = (unsigned int) (key >> 32);
+      header[4] = (unsigned int) (input->size & 0xffffffffu);
+      header[5] = (unsigned int) ((unsigned long long) input->size >> 32);
+      header[6] = (unsigned int) (stream.count & 0xffffffffu);
+      header[7] = (unsigned int) ((unsigned long long) stream.count >> 32);
+      header[8] = (unsigned int) (check & 0xffffffffu);
+      header[9] = (unsigned int) (check >> 32);
+      iov[0].iov_base = header;
+      iov[0].iov_len = sizeof(header);
+      iov[1].iov_base = stream.ops;
+      iov[1].iov_len = stream.count * sizeof(int);
+
+      /*threads of a batch may compile the same script, and a crashed run*/
+      /*may have left a name behind, so each try takes a new number*/
+      for (tries = 0; (fd < 0) && (tries < CACHE_TRIES); tries++)
+	{
+	  sprintf(temp, "%s.%d.%u", name, (int) getpid(), __atomic_fetch_add(&compile_serial, 1, __ATOMIC_RELAXED));
+	  fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+	  if ((fd < 0) && (errno != EEXIST)) break;
+	}
+      if (fd < 0) error = -1;
+      else
+	{
+	  error = write_parts(fd, iov, 2);
+	  if ((close(fd) != 0) && (error == NO_ERROR)) error = ERR_WRITE;
+	  if ((error == NO_ERROR) && (rename(temp, name) != 0)) error = ERR_CREATEFILE;
+	  if (error != NO_ERROR)
+	    {
+	      unlink(temp);
+	      error = -1;
+	    }
+	}
+    }
+  free(temp);
+  free(name);
+  free(stream.ops);
+  return error;
+}
+
+/*run_cached runs the compiled form of the script when there is one made*/
+/*from the same text and starting size. It returns -1 when there isn't, so*/
+/*the script is interpreted instead.*/
+
+int run_cached (script_ptr input, const char *filename, scene_ptr sc)
+{
+  struct stat info;
+  const unsigned int *header;
+  unsigned long long key, count, check;
+  char *name;
+  void *map;
+  double start;
+  int fd, error = -1;
+
+  if (input->capacity != 0) return -1;
+  name = cache_name(filename);
+  if (name == NULL) return -1;
+  fd = open(name, O_RDONLY);
+  free(name);
+  if (fd < 0) return -1;
+
+  if ((fstat(fd, &info) != 0) || (info.st_size < CACHE_HEADER * (off_t) sizeof(int)))
+    {
+      close(fd);
+      return -1;
+    }
+  map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return -1;
+
+  header = map;
+  key = header[2] | ((unsigned long long) header[3] << 32);
+  count = header[6] | ((unsigned long long) header[7] << 32);
+  check = header[8] | ((unsigned long long) header[9] << 32);
+  if ((header[0] == CACHE_MAGIC) && (header[1] == CACHE_VERSION)
+      && (header[4] == (unsigned int) (input->size & 0xffffffffu))
+      && (header[5] == (unsigned int) ((unsigned long long) input->size >> 32))
+      && (count * sizeof(int) == info.st_size - CACHE_HEADER * sizeof(int))
+      && (key == script_key(input, &sc->cv))
+      && (check == hash_bytes(header + CACHE_HEADER, count * sizeof(int), 0xcbf29ce484222325ULL)))
+    {
+      start = (sc->stats != NULL) ? stats_clock() : 0;
+      error = run_compiled((const int *) (header + CACHE_HEADER), count, sc);
+      if (sc->stats != NULL) sc->stats->seconds[STAGE_DISPATCH] += stats_clock() - start;
+    }
+  munmap(map, info.st_size);
+  return error;
+}
+
+/*run_compiled carries out the operations of a compiled script. They were*/
+/*checked when the script was compiled, so only the file errors of SAVE and*/
+/*GRAP and running out of memory can happen here.*/
+
+int run_compiled (const int *ops, size_t count, scene_ptr sc)
+{
+  static const int length[OP_ERROR + 1] = { 1, 5, 7, 7, 6, 3, 6, 3, 3, 2 };
+  pool_ptr pool;
+  const int *tail;
+  size_t pc = 0;
+  int error = NO_ERROR, slot, field, op, kind;
+  float scale, offset;
+
+  while ((error == NO_ERROR) && (pc < count))
+    {
+      op = ops[pc];
+      if ((op < 0) || (op > OP_ERROR) || (pc + length[op] > count)) return ERR_READ;
+      if ((op == OP_GRAPH) || (op == OP_SAVE))
+	{
+	  /*the path, and what follows it, must end inside the stream*/
+	  if ((ops[pc + 2] < 1) || (pc + length[op] + ops[pc + 2] > count) || (((const char *) (ops + pc + 3))[ops[pc + 2] * sizeof(int) - 1] != '\0')) return ERR_READ;
+	}
+      if ((sc->stats != NULL) && (op != OP_END)) sc->stats->commands[op]++;
+
+      switch (op)
+	{
+	case OP_END:
+	  return NO_ERROR;
+
+	case OP_POINT:
+	case OP_LINE:
+	case OP_BOX:
+	case OP_CIRCLE:
+	  pool = shape_pool_of(sc, "PLBC"[op - OP_POINT], &kind);
+	  slot = place_shape(&sc->cv, pool, op - OP_POINT, ops[pc + 1]);
+	  if (slot < 0) return ERR_MEMORY;
+	  for (field = 0; field < pool->fields; field++) pool->coord[field][slot] = ops[pc + 2 + field];
+	  pool->color[slot] = ops[pc + 2 + pool->fields];
+	  attach_shape (&sc->cv, pool, op - OP_POINT, slot);
+	  break;
+
+	case OP_DELETE:
+	  pool = shape_pool_of(sc, (char) ops[pc + 1], &kind);
+	  if (pool != NULL) remove_shape(&sc->cv, pool, kind - OP_POINT, ops[pc + 2]);
+	  else if ((char) ops[pc + 1] == 'G') delete_series(&sc->graphs, ops[pc + 2] + 1, &sc->cv);
+	  break;
+
+	case OP_GRAPH:
+	  tail = ops + pc + 3 + ops[pc + 2];
+	  memcpy(&scale, tail + 1, sizeof(float));
+	  memcpy(&offset, tail + 2, sizeof(float));
+	  error = load_series(&sc->graphs, tail[0], (const char *) (ops + pc + 3), ops[pc + 1], scale, offset, &sc->cv);
+	  pc += ops[pc + 2];
+	  break;
+
+	case OP_SAVE:
+	  error = save_image((const char *) (ops + pc + 3), ops[pc + 1], sc);
+	  pc += ops[pc + 2];
+	  break;
+
+	case OP_SIZE:
+	  error = scene_size(sc, ops[pc + 1], ops[pc + 2]);
+	  break;
+
+	case OP_ERROR:
+	  return ops[pc + 1];
+	}
+      pc += length[op];
+    }
+  return error;
+}
+
+/*process analyzes command line and calls on the function for the corresponding*/
+/*command*/
+
+int process (command_ptr cmd, scene_ptr sc)
+{
+  int error = NO_ERROR;
+
+  switch (cmd->word[0].text[0])
+    {
+    case 'P':
+      error = load_point (cmd, &sc->points, &sc->cv);
+      break;
+     
+    case 'L':
+      error = load_line (cmd, &sc->lines, &sc->cv);
+      break;
+    
+    case 'B':
+      error = load_box (cmd, &sc->boxes, &sc->cv);
+      break;
+ 
+    case 'C':
+      error = load_circle (cmd, &sc->circles, &sc->cv);
+      break;
+    }
+  
+  if (field_is(&cmd->word[0], "MOVE"))
+    {
+      switch (cmd->word[1].text[0])
+        {
+	case 'P':
+	  error = move_point (cmd, &sc->points, &sc->cv);
+	  break;
+     
+	case 'L':
+	  error = move_line (cmd, &sc->lines, &sc->cv);
+	  break;
+    
+	case 'B':
+	  error = move_box (cmd, &sc->boxes, &sc->cv);
+	  break;
+ 
+	case 'C':
+	  error = move_circle (cmd, &sc->circles, &sc->cv);
+	  break;
+        }
+
+    }
+
+  if (field_is(&cmd->word[0], "DELT"))
+    {
+      switch (cmd->word[1].text[0])
+        {
+	case 'P':
+	  delete_point (cmd, &sc->points, &sc->cv);
+	  break;
+     
+	case 'L':
+	  delete_line (cmd, &sc->lines, &sc->cv);
+	  break;
+    
+	case 'B':
+	  delete_box (cmd, &sc->boxes, &sc->cv);
+	  break;
+ 
+	case 'C':
+	  delete_circle (cmd, &sc->circles, &sc->cv);
+	  break;
+
+	case 'G':
+	  if (field_number(&cmd->word[1]) > 0) delete_series (&sc->graphs, field_number(&cmd->word[1]), &sc->cv);
+	  break;
+        }
+    }
+  
+  if (graph_word(&cmd->word[0])) error = load_graph(cmd, &sc->graphs, &sc->cv);
+
+  if (field_is(&cmd->word[0], "SAVE")) error = save_work(cmd, sc);
+
+  if (field_is(&cmd->word[0], "SIZE")) error = set_size(cmd, sc);
+  
+  return error;  
+}
+
+/*parse_number reads a number from text the way atoi does: leading blanks,*/
+/*an optional sign, then digits up to the first other character. Numbers too*/
+/*large for a long are clamped before being cut down to an int, like atoi.*/
+
+static int parse_number (const char *text, int length)
+{
+  unsigned long value = 0, limit;
+  int count = 0, negative = 0, digit;
+
+  while ((count < length) && isspace((unsigned char) text[count])) count++;
+  if ((count < length) && ((text[count] == '-') || (text[count] == '+')))
+    {
+      negative = (text[count] == '-');
+      count++;
+    }
+  limit = negative ? (unsigned long) LONG_MAX + 1 : (unsigned long) LONG_MAX;
+  for (; (count < length) && isdigit((unsigned char) text[count]); count++)
+    {
+      digit = text[count] - '0';
+      if (value > (limit - digit) / 10) value = limit;
+      else value = value * 10 + digit;
+    }
+  return (int) (negative ? (long) (0UL - value) : (long) value);
+}
+
+/*set_field points f at text with the blanks around it left out and reads*/
+/*its number*/
+
+static void set_field (field_ptr f, const char *text, const char *end)
+{
+  while ((text < end) && isspace((unsigned char) *text)) text++;
+  while ((end > text) && isspace((unsigned char) end[-1])) end--;
+  f->text = text;
+  f->length = end - text;
+  f->value = parse_number(text, f->length);
+}
+
+/*tokenize splits a line into the command word, which ends at the first*/
+/*blank, and the comma-separated fields after it in one pass over the line.*/
+/*Blanks around every word are dropped. It returns the number of words, 0*/
+/*for a blank line.*/
+
+int tokenize (const char *line, size_t length, command_ptr cmd)
+{
+  const char *end = line + length, *start, *comma;
+  int count;
+
+  for (count = 0; count < PARAM_MAX; count++)
+    {
+      cmd->word[count].text = "";
+      cmd->word[count].length = 0;
+      cmd->word[count].value = 0;
+    }
+  cmd->count = 0;
+
+  while ((line < end) && isspace((unsigned char) *line)) line++;
+  if (line == end) return 0;
+
+  start = line;
+  while ((line < end) && !isspace((unsigned char) *line)) line++;
+  set_field(&cmd->word[0], start, line);
+  cmd->count = 1;
+
+  while ((line < end) && isspace((unsigned char) *line)) line++;
+  if (line == end) return cmd->count;
+
+  /*Every comma starts a new field, so a trailing comma gives an empty one*/
+  while (cmd->count < PARAM_MAX)
+    {
+      comma = memchr(line, ',', end - line);
+      if (comma == NULL) comma = end;
+      set_field(&cmd->word[cmd->count], line, comma);
+      cmd->count++;
+      if (comma == end) break;
+      line = comma + 1;
+    }
+  return cmd->count;
+}
+
+/*field_number reads the object number that follows the letter of a shape*/
+/*name like P12*/
+
+int field_number (field_ptr f)
+{
+  if (f->length == 0) return 0;
+  return parse_number(f->text + 1, f->length - 1);
+}
+
+/*field_is tells whether f is exactly word*/
+
+int field_is (field_ptr f, const char *word)
+{
+  return (strlen(word) == (size_t) f->length) && (memcmp(f->text, word, f->length) == 0);
+}
+
+/*graph_word tells whether f names a graph series: GRAP, or G followed by*/
+/*the digits of its number*/
+
+int graph_word (field_ptr f)
+{
+  int count;
+
+  if (field_is(f, "GRAP")) return 1;
+  if ((f->length < 2) || (f->text[0] != 'G')) return 0;
+  for (count = 1; count < f->length; count++)
+    if (!isdigit((unsigned char) f->text[count])) return 0;
+  return 1;
+}
+
+/*field_path copies f into path as a file name, failing if it doesn't fit*/
+
+int field_path (field_ptr f, char *path, int size)
+{
+  path[0] = '\0';
+  if ((f->length == 0) || (f->length >= size)) return ERR_CREATEFILE;
+  memcpy(path, f->text, f->length);
+  path[f->length] = '\0';
+  return NO_ERROR;
+}
+
+/*field_float reads f as a decimal number, or gives otherwise when it is*/
+/*empty or doesn't start with a number*/
+
+float field_float (field_ptr f, float otherwise)
+{
+  char text[64], *end;
+  double value;
+
+  if ((f->length == 0) || (f->length >= (int) sizeof(text))) return otherwise;
+  memcpy(text, f->text, f->length);
+  text[f->length] = '\0';
+  value = strtod(text, &end);
+  return (end == text) ? otherwise : (float) value;
+}
+
+/*load_point load information for a point to its structure and returns any*/
+/*error flag if there is an error*/
+
+int load_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv)
+{
+  int pnum, colnum, pointx, pointy, slot;
+
+  pnum = field_number(&cmd->word[0]) - 1;
+  if (pnum > -1)
+    {
+      pointx = cmd->word[1].value;
+      pointy = cmd->word[2].value;
+      if ((pointx < 1) || (pointy < 1) || (pointx > cv->width) || (pointy > cv->height)) 
+	{
+	  return ERR_POINT;
+	}
+      else
+	{
+	  slot = place_shape(cv, ps, SHAPE_POINT, pnum);
+	  if (slot < 0) return ERR_MEMORY;
+	  ps->coord[PT_X][slot] = pointx;
+	  ps->coord[PT_Y][slot] = pointy;
+	  attach_shape (cv, ps, SHAPE_POINT, slot);
+	}
+      colnum = cmd->word[3].value;
+      if ((colnum < 0) || (colnum > 4)) ps->color[slot] = 1;
+      else ps->color[slot] = colnum;
+      return NO_ERROR;
+    }
+  else return ERR_POINTMAX;
+} 
+
+/*load_line loads information for a line to its structure and returns an error */
+/*flag if an error has occured*/
+
+int load_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv)
+{
+  int lnum, colnum, x1, x2, y1, y2, slot;
+
+  lnum = field_number(&cmd->word[0]) - 1;
+
+  if (lnum > -1)
+    {
+      x1 = cmd->word[1].value;
+      y1 = cmd->word[2].value;
+      x2 = cmd->word[3].value;
+      y2 = cmd->word[4].value;
+
+      if ((x1 < 1) || (x2 < 1) || (x1 > cv->width) || (x2 > cv->width) || (y1 < 1) || (y2 < 1) || (y1 > cv->height) || (y2 > cv->height))
+	{
+	  return ERR_LINE;
+	}
+      else {
+	slot = place_shape(cv, ls, SHAPE_LINE, lnum);
+	if (slot < 0) return ERR_MEMORY;
+	ls->coord[LN_X1][slot] = x1;
+	ls->coord[LN_Y1][slot] = y1;
+	ls->coord[LN_X2][slot] = x2;
+	ls->coord[LN_Y2][slot] = y2;
+	attach_shape (cv, ls, SHAPE_LINE, slot);
+      }
+
+      colnum = cmd->word[5].value;
+      if ((colnum < 0) || (colnum > 4)) ls->color[slot] = 1;
+      else ls->color[slot] = colnum;
+      return NO_ERROR;
+    }
+
+  else return ERR_LINEMAX;      
+}
+
+/*load_box loads information for a box to its structure and returns an error */
+/*flag if an error has occured*/
+
+int load_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv)
+{
+  int bnum, colnum, x1, y1, x2, y2, slot;
+
+  bnum = field_number(&cmd->word[0]) - 1;
+
+  if (bnum > -1)
+    {
+      x1 = cmd->word[1].value;
+      y1 = cmd->word[2].value;
+      x2 = cmd->word[3].value;
+      y2 = cmd->word[4].value;
+      if ((x1 < 1) || (x2 < 1) || (x1 > cv->width) || (x2 > cv->width) || (y1 < 1) || (y2 < 1) || (y1 > cv->height) || (y2 > cv->height))
+	{
+	  return ERR_BOX;
+	}
+      else {
+	if ((x2 < x1) || (y2 > y1)) return ERR_BOXCORNER;
+	else {
+	  slot = place_shape(cv, bs, SHAPE_BOX, bnum);
+	  if (slot < 0) return ERR_MEMORY;
+	  bs->coord[BX_LEFT][slot] = x1;
+	  bs->coord[BX_TOP][slot] = y1;
+	  bs->coord[BX_RIGHT][slot] = x2;
+	  bs->coord[BX_BOTTOM][slot] = y2;
+	  attach_shape (cv, bs, SHAPE_BOX, slot);
+	}
+      }
+      colnum = cmd->word[5].value;
+      if ((colnum < 0) || (colnum > 4)) bs->color[slot] = 1;
+      else bs->color[slot] = colnum;
+      return NO_ERROR;
+    }
+
+  else return ERR_BOXMAX;
+}
+
+/*load_circle loads information for a circle to its structure and returns an error*/
+/*flag if an error has occured*/
+
+int load_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv)
+{
+  int cnum, colnum, x, y, rad, slot;
+
+  cnum = field_number(&cmd->word[0]) - 1;
+
+  if (cnum > -1)
+    {
+      x = cmd->word[1].value;
+      y = cmd->word[2].value;
+      if ((x < 1) || (y < 1) || (x > cv->width) || (y > cv->height))
+	{
+	  return ERR_CENTER;
+	}
+      else {
+	rad = cmd->word[3].value;
+	if ((rad < 0) || (rad > radius_max(cv))) return ERR_RADIUSMAX;
+	else {
+	  slot = place_shape(cv, cs, SHAPE_CIRCLE, cnum);
+	  if (slot < 0) return ERR_MEMORY;
+	  cs->coord[CR_X][slot] = x;
+	  cs->coord[CR_Y][slot] = y;
+	  cs->coord[CR_RADIUS][slot] = rad;
+	  attach_shape (cv, cs, SHAPE_CIRCLE, slot);
+	}
+	colnum = cmd->word[4].value;
+	if ((colnum < 0) || (colnum > 4)) cs->color[slot] = 1;
+	else cs->color[slot] = colnum;
+	return NO_ERROR;
+      }
+    }
+
+  else return ERR_CIRCLEMAX;
+}
+
+/*load_graph loads information for a graph to its structure and returns an error */
+/*flag if an error has occured. GRAP loads series 0 and Gn series n, each*/
+/*taking an optional scale and offset after the color.*/
+
+int load_graph (command_ptr cmd, graph_set_ptr gs, canvas_ptr cv)
+{
+  char path[PATH_MAX];
+  int colnum, id;
+
+  id = field_is(&cmd->word[0], "GRAP") ? 0 : field_number(&cmd->word[0]);
+  if ((id < 1) && !field_is(&cmd->word[0], "GRAP")) return ERR_SERIES;
+  field_path(&cmd->word[1], path, PATH_MAX);
+  colnum = cmd->word[2].value;
+  if ((colnum < 0) || (colnum > 4)) colnum = 1;
+  return load_series (gs, id, path, colnum, field_float(&cmd->word[3], 1.0f), field_float(&cmd->word[4], 0.0f), cv);
+}
+
+/*load_series reads the file path into series id, adding the series if*/
+/*there is none. A new series that can't be read is dropped again.*/
+
+int load_series (graph_set_ptr gs, int id, const char *path, int color, float scale, float offset, canvas_ptr cv)
+{
+  graph_ptr g;
+  int fresh, error;
+
+  g = place_series(gs, id);
+  if (g == NULL) return ERR_MEMORY;
+  fresh = (g->low == NULL);
+  error = read_graph (path, color, g, cv);
+  if (error != NO_ERROR)
+    {
+      if (fresh) delete_series (gs, id, cv);
+      return error;
+    }
+  g->scale = scale;
+  g->offset = offset;
+  return NO_ERROR;
+}
+
+/*place_series returns series id, adding an empty one in the order of ids*/
+/*when there is none. It returns NULL when out of memory.*/
+
+graph_ptr place_series (graph_set_ptr gs, int id)
+{
+  graph *series;
+  int count, capacity;
+
+  for (count = 0; count < gs->count; count++)
+    {
+      if (gs->series[count].id == id) return &gs->series[count];
+      if (gs->series[count].id > id) break;
+    }
+  if (gs->count == gs->capacity)
+    {
+      capacity = (gs->capacity == 0) ? 4 : 2 * gs->capacity;
+      series = realloc(gs->series, capacity * sizeof(graph));
+      if (series == NULL) return NULL;
+      gs->series = series;
+      gs->capacity = capacity;
+    }
+  memmove(gs->series + count + 1, gs->series + count, (gs->count - count) * sizeof(graph));
+  gs->count++;
+  initialize_graph (&gs->series[count]);
+  gs->series[count].id = id;
+  return &gs->series[count];
+}
+
+/*delete_series removes series id, if there is one*/
+
+void delete_series (graph_set_ptr gs, int id, canvas_ptr cv)
+{
+  int count;
+
+  for (count = 0; count < gs->count; count++)
+    {
+      if (gs->series[count].id != id) continue;
+      free (gs->series[count].low);
+      memmove(gs->series + count, gs->series + count + 1, (gs->count - count - 1) * sizeof(graph));
+      gs->count--;
+      cv->dirty_all = 1;
+      return;
+    }
+}
+
+/*read_floats reads up to count samples, stopping early only at the end of*/
+/*the file. It returns the samples read, or -1 on an error.*/
+
+static long read_floats (int fd, float *samples, size_t count)
+{
+  size_t done = 0;
+  ssize_t got;
+
+  while (done < count * sizeof(float))
+    {
+      got = read(fd, (char *) samples + done, count * sizeof(float) - done);
+      if ((got < 0) && (errno == EINTR)) continue;
+      if (got < 0) return -1;
+      if (got == 0) break;
+      done += got;
+    }
+  return (long) (done / sizeof(float));
+}
+
+/*graph_sample turns a NaN sample into 0. The rest are kept as they are*/
+/*and only clamped to the canvas once scaled.*/
+
+static float graph_sample (float sample)
+{
+  return (sample == sample) ? sample : 0.0f;
+}
+
+#ifdef SPAN_SIMD
+
+/*range_sse widens low and high to the samples, eight at a time in two*/
+/*pairs of registers. Like the scalar loop it skips NaNs.*/
+
+__attribute__((target("sse"))) static void range_sse (const float *samples, size_t count, float *low, float *high)
+{
+  __m128 low0 = _mm_set1_ps(*low), high0 = _mm_set1_ps(*high), low1 = low0, high1 = high0, value;
+  float lows[4], highs[4];
+  size_t n;
+
+  for (n = 0; n + 8 <= count; n += 8)
+    {
+      value = _mm_loadu_ps(samples + n);
+      low0 = _mm_min_ps(value, low0);
+      high0 = _mm_max_ps(value, high0);
+      value = _mm_loadu_ps(samples + n + 4);
+      low1 = _mm_min_ps(value, low1);
+      high1 = _mm_max_ps(value, high1);
+    }
+  _mm_storeu_ps(lows, _mm_min_ps(low0, low1));
+  _mm_storeu_ps(highs, _mm_max_ps(high0, high1));
+  for (count -= n, samples += n, n = 0; n < 4; n++)
+    {
+      if (lows[n] < *low) *low = lows[n];
+      if (highs[n] > *high) *high = highs[n];
+    }
+  for (n = 0; n < count; n++)
+    {
+      if (samples[n] < *low) *low = samples[n];
+      if (samples[n] > *high) *high = samples[n];
+    }
+}
+
+#endif
+
+/*sample_range widens low and high to take in count samples. NaNs are*/
+/*skipped.*/
+
+void sample_range (const float *samples, size_t count, float *low, float *high)
+{
+  size_t n;
+
+#ifdef SPAN_SIMD
+  if ((count >= 16) && __builtin_cpu_supports("sse"))
+    {
+      range_sse (samples, count, low, high);
+      return;
+    }
+#endif
+  for (n = 0; n < count; n++)
+    {
+      if (samples[n] < *low) *low = samples[n];
+      if (samples[n] > *high) *high = samples[n];
+    }
+}
+
+/*read_graph reads the samples of the file path into the columns of the*/
+/*canvas. A file of no more samples than columns gives one sample per column*/
+/*from the left, as it always has. A longer one is read GRAPH_BLOCK samples*/
+/*at a time and each column keeps the lowest and highest of its share of*/
+/*them, so it is drawn as the envelope of the whole file in one pass and*/
+/*bounded memory. Columns past the end of the samples are at zero.*/
+
+int read_graph (const char *path, int color, graph_ptr g, canvas_ptr cv)
+{
+  struct stat info;
+  unsigned long long total, done = 0, end;
+  float *low, *block, least, most;
+  long got, used, take;
+  int fd, column = 0, error = NO_ERROR;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return ERR_GRAPHFILE;
+  if (g->count != cv->width)
+    {
+      low = realloc(g->low, 2 * (size_t) cv->width * sizeof(float));
+      if (low == NULL)
+	{
+	  close(fd);
+	  return ERR_MEMORY;
+	}
+      g->low = low;
+      g->count = cv->width;
+    }
+  g->high = g->low + g->count;
+  memset(g->low, 0, 2 * (size_t) g->count * sizeof(float));
+
+  /*only a regular file says how many samples there are to share out*/
+  total = g->count;
+  if ((fstat(fd, &info) == 0) && S_ISREG(info.st_mode)) total = info.st_size / sizeof(float);
+
+  if (total <= (unsigned long long) g->count)
+    {
+      got = read_floats(fd, g->low, total);
+      if (got < 0) error = ERR_GRAPHFILE;
+      for (used = 0; used < got; used++) g->low[used] = g->high[used] = graph_sample(g->low[used]);
+    }
+  else
+    {
+      block = malloc(GRAPH_BLOCK * sizeof(float));
+      if (block == NULL) error = ERR_MEMORY;
+      least = HUGE_VALF;
+      most = -HUGE_VALF;
+      end = total / g->count;
+      while ((error == NO_ERROR) && (done < total))
+	{
+	  got = read_floats(fd, block, (total - done < GRAPH_BLOCK) ? total - done : GRAPH_BLOCK);
+	  if (got <= 0)
+	    {
+	      error = ERR_GRAPHFILE;
+	      break;
+	    }
+	  for (used = 0; used < got; used += take)
+	    {
+	      take = (end - done < (unsigned long long) (got - used)) ? (long) (end - done) : got - used;
+	      sample_range (block + used, take, &least, &most);
+	      done += take;
+	      if (done < end) continue;
+
+	      /*the column is complete: keep it and start the next*/
+	      g->low[column] = (least <= most) ? graph_sample(least) : 0.0f;
+	      g->high[column] = (least <= most) ? graph_sample(most) : 0.0f;
+	      column++;
+	      least = HUGE_VALF;
+	      most = -HUGE_VALF;
+	      end = total * (column + 1) / g->count;
+	    }
+	}
+      free(block);
+    }
+  close(fd);
+  if (error != NO_ERROR) return error;
+
+  g->color = color;
+  cv->dirty_all = 1;
+  return NO_ERROR;
+}
+
+/*print_error prints out the specific error brought by the error flag*/
+
+void print_error (int error)
+{
+  printf ("%s\n", error_message(error));
+}
+
+/*error_message returns the message of an error flag*/
+
+const char *error_message (int error)
+{
+  switch (error)
+    {
+    case ERR_CREATEFILE:
+      return "ERROR: Output File can't be created.";
+
+    case ERR_HEADER:
+      return "ERROR: Can't create bitmap header.";
+
+    case ERR_POINTMAX:
+      return "ERROR: Invalid Point Number.";
+
+    case ERR_POINT:
+      return "ERROR: Point not within canvas.";
+
+    case ERR_LINEMAX:
+      return "ERROR: Invalid Line Number.";
+
+    case ERR_LINE:
+      return "ERROR: Endpoint(s) of line not within canvas.";
+
+    case ERR_BOXMAX:
+      return "ERROR: Invalid Box Number.";
+
+    case ERR_BOX:
+      return "ERROR: Top left corner and/or bottom right corner of box not within canvas.";
+
+    case ERR_BOXCORNER:
+      return "ERROR: Invalid corner(s).";
+
+    case ERR_CIRCLEMAX:
+      return "ERROR: Invalid Circle Number.";
+
+    case ERR_RADIUSMAX:
+      return "ERROR: Invalid Circle Radius.";
+
+    case ERR_CENTER:
+      return "ERROR: Center of Circle not within canvas.";
+
+    case ERR_MOVPT:
+      return "ERROR: Center of Shape not within canvas.";
+
+    case ERR_MOVSHAPE:
+      return "ERROR: Some points of shape not within canvas.";
+
+    case ERR_MEMORY:
+      return "ERROR: Out of memory.";
+
+    case ERR_SIZE:
+      return "ERROR: Invalid canvas size.";
+
+    case ERR_WRITE:
+      return "ERROR: Output File can't be written.";
+
+    case ERR_READ:
+      return "ERROR: Input file can't be read.";
+
+    case ERR_COMPILE:
+      return "ERROR: Only a regular input file can be compiled.";
+
+    case ERR_OPENFILE:
+      return "ERROR: Input file can't be opened!";
+
+    case ERR_GRAPHFILE:
+      return "ERROR: Graph data file can't be opened or read.";
+
+    case ERR_SERIES:
+      return "ERROR: Graph series number is out of range.";
+
+    case ERR_SOCKET:
+      return "ERROR: Socket can't be created or listened on.";
+
+    case ERR_BUFFER:
+      return "ERROR: Buffer is too small for the picture.";
+    }
+  return "ERROR: Unknown error.";
+}
+
+/*delete_point deletes the point by deactivating the occupied flag*/
+
+void delete_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv)
+{
+  int pnum;
+
+  pnum = field_number(&cmd->word[1]) - 1;
+
+  if (pnum > -1) remove_shape(cv, ps, SHAPE_POINT, pnum);
+}
+
+/*delete_line deletes the line by deactivating the occupied flag*/
+
+void delete_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv)
+{
+  int lnum;
+
+  lnum = field_number(&cmd->word[1]) - 1;
+
+  if (lnum > -1) remove_shape(cv, ls, SHAPE_LINE, lnum);
+}
+
+/*delete_box deletes the box by deactivating the occupied flag*/
+
+void delete_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv)
+{
+  int bnum;
+
+  bnum = field_number(&cmd->word[1]) - 1;
+
+  if (bnum > -1) remove_shape(cv, bs, SHAPE_BOX, bnum);
+}
+
+/*delete_circle deletes the circle by deactivating the occupied flag*/
+
+void delete_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv)
+{
+  int cnum;
+
+  cnum = field_number(&cmd->word[1]) - 1;
+
+  if (cnum > -1) remove_shape(cv, cs, SHAPE_CIRCLE, cnum);
+}
+
+/*move_point moves point by changing the coordinates of the point to the */
+/*coordinates found in the command*/
+
+int move_point (command_ptr cmd, pts_ptr ps, canvas_ptr cv)
+{
+  int pnum, colnum, x, y, slot;
+
+  pnum = field_number(&cmd->word[1]) - 1;
+
+  if (pnum > -1)
+    {
+      slot = pool_find(ps, pnum);
+      if (slot >= 0)
+	{
+	  x = cmd->word[2].value;
+	  y = cmd->word[3].value;
+	  if ((x < 1) || (y < 1) || (x > cv->width) || (y > cv->height))
+	    {
+	      return ERR_MOVPT;
+	    }
+	  else {
+	    detach_shape (cv, ps, SHAPE_POINT, slot);
+	    ps->coord[PT_X][slot] = x;
+	    ps->coord[PT_Y][slot] = y;
+	    attach_shape (cv, ps, SHAPE_POINT, slot);
+	    colnum = cmd->word[4].value;
+	    if ((colnum < 0) || (colnum > 4)) ps->color[slot] = 1;
+	    else ps->color[slot] = colnum;
+	  }
+	}
+    } 
+  return NO_ERROR;
+} 
+
+/*move_line moves a line by computing the difference of the center of the line and*/
+/*the point indicated by the command and by adding this difference to the */
+/*coordinate information of the line*/
+
+int move_line (command_ptr cmd, ln_ptr ls, canvas_ptr cv)
+{
+  int lnum, colnum, x1, x2, y1, y2, diffx, diffy, cenx, ceny, ncenx, nceny, slot;
+
+  lnum = field_number(&cmd->word[1]) - 1;
+
+  if (lnum > -1)
+  {
+     slot = pool_find(ls, lnum);
+     if (slot >= 0)
+     {
+        compute_midpt(&cenx, &ceny, ls->coord[LN_X1][slot], ls->coord[LN_Y1][slot], ls->coord[LN_X2][slot], ls->coord[LN_Y2][slot]);
+        ncenx = cmd->word[2].value;
+        nceny = cmd->word[3].value;
+
+        if ((ncenx < 1) || (nceny < 1) || (ncenx > cv->width) || (nceny > cv->height))
+        {
+           return ERR_MOVPT;
+        }
+        else {
+          diffx = ncenx - cenx;
+          diffy = nceny - ceny;
+        
+          x1 = ls->coord[LN_X1][slot] + diffx;
+          x2 = ls->coord[LN_X2][slot] + diffx;
+          y1 = ls->coord[LN_Y1][slot] + diffy;
+          y2 = ls->coord[LN_Y2][slot] + diffy;
+ 
+          if ((x1 < 1) || (y1 < 1) || (x2 < 1) || (y2 < 1) || (x1 > cv->width) || (y1 > cv->height) || (x2 > cv->width) || (y2 > cv->height))
+          {
+             return ERR_MOVSHAPE;
+          }
+          else {
+            detach_shape (cv, ls, SHAPE_LINE, slot);
+            ls->coord[LN_X1][slot] = x1;
+            ls->coord[LN_X2][slot] = x2;
+            ls->coord[LN_Y1][slot] = y1;
+            ls->coord[LN_Y2][slot] = y2;
+            attach_shape (cv, ls, SHAPE_LINE, slot);
+            colnum = cmd->word[4].value;
+            if ((colnum < 0) || (colnum > 4)) ls->color[slot] = 1;
+            else ls->color[slot] = colnum;
+          }
+        }
+     }
+  }
+  return NO_ERROR;
+}
+
+/*move_box moves a line by computing the difference of the center of the box and*/
+/*the point indicated by the command and by adding this difference to the */
+/*coordinate information of the box*/
+
+int move_box (command_ptr cmd, bx_ptr bs, canvas_ptr cv)
+{
+  int bnum, colnum, x1, x2, y1, y2, diffx, diffy, cenx, ceny, ncenx, nceny, slot;
+
+  bnum = field_number(&cmd->word[1]) - 1;
+
+  if (bnum > -1)
+  {
+     slot = pool_find(bs, bnum);
+     if (slot >= 0)
+     {
+        compute_midpt(&cenx, &ceny, bs->coord[BX_LEFT][slot], bs->coord[BX_TOP][slot], bs->coord[BX_RIGHT][slot], bs->coord[BX_BOTTOM][slot]);
+        ncenx = cmd->word[2].value;
+        nceny = cmd->word[3].value;
+
+        if ((ncenx < 1) || (nceny < 1) || (ncenx > cv->width) || (nceny > cv->height))
+        {
+           return ERR_MOVPT;
+        }
+        else {
+          diffx = ncenx - cenx;
+          diffy = nceny - ceny;
+        
+          x1 = bs->coord[BX_LEFT][slot] + diffx;
+          x2 = bs->coord[BX_RIGHT][slot] + diffx;
+          y1 = bs->coord[BX_TOP][slot] + diffy;
+          y2 = bs->coord[BX_BOTTOM][slot] + diffy;
+ 
+          if ((x1 < 1) || (y1 < 1) || (x2 < 1) || (y2 < 1) || (x1 > cv->width) || (y1 > cv->height) || (x2 > cv->width) || (y2 > cv->height))
+          {
+             return ERR_MOVSHAPE;
+          }
+          else {
+            detach_shape (cv, bs, SHAPE_BOX, slot);
+            bs->coord[BX_LEFT][slot] = x1;
+            bs->coord[BX_RIGHT][slot] = x2;
+            bs->coord[BX_TOP][slot] = y1;
+            bs->coord[BX_BOTTOM][slot] = y2;
+            attach_shape (cv, bs, SHAPE_BOX, slot);
+
+            colnum = cmd->word[4].value;
+            if ((colnum < 0) || (colnum > 4)) bs->color[slot] = 1;
+            else bs->color[slot] = colnum;
+          }
+        }
+     }
+  }
+  return NO_ERROR;
+}
+
+/*move_circle moves point by changing the center of the point to the */
+/*coordinates found in the command*/
+
+int move_circle (command_ptr cmd, cir_ptr cs, canvas_ptr cv)
+{
+  int cnum, colnum, cenx, ceny, slot;
+
+  cnum = field_number(&cmd->word[1]) - 1;
+
+  if (cnum > -1)
+    {
+      slot = pool_find(cs, cnum);
+      if (slot >= 0)
+	{
+	  cenx = cmd->word[2].value;
+	  ceny = cmd->word[3].value;
+	  if ((cenx < 1) || (ceny < 1) || (cenx > cv->width) || (ceny > cv->height))
+	    {
+	      return ERR_MOVPT;
+	    }
+	  else {
+	    detach_shape (cv, cs, SHAPE_CIRCLE, slot);
+	    cs->coord[CR_X][slot] = cenx;
+	    cs->coord[CR_Y][slot] = ceny;
+	    attach_shape (cv, cs, SHAPE_CIRCLE, slot);
+	    colnum = cmd->word[4].value;
+	    if ((colnum < 0) || (colnum > 4)) cs->color[slot] = 1;
+	    else cs->color[slot] = colnum;
+	  }
+	}
+    } 
+  return NO_ERROR;
+}
+
+/*save_work saves the objects created by creating and then writing info to the*/
+/*bitmap file*/
+
+int save_work (command_ptr cmd, scene_ptr sc)
+{
+  char path[PATH_MAX];
+
+  if (field_path(&cmd->word[1], path, PATH_MAX) != NO_ERROR) return ERR_CREATEFILE;
+  return save_image (path, save_mode(&cmd->word[2]), sc);
+}
+
+/*save_mode reads the way to write the file from the word after its name*/
+
+int save_mode (field_ptr f)
+{
+  if (field_is(f, "MMAP")) return SAVE_MMAP;
+  if (field_is(f, "RLE")) return SAVE_RLE;
+  if (field_is(f, "PNG")) return SAVE_PNG;
+  if (field_is(f, "QOI")) return SAVE_QOI;
+  return SAVE_PLAIN;
+}
+
+/*path_format gives the save mode a file name asks for by its extension:*/
+/*SAVE_PNG for .png, SAVE_QOI for .qoi and SAVE_PLAIN for anything else*/
+
+int path_format (const char *path)
+{
+  const char *dot = strrchr(path, '.');
+
+  if (dot == NULL) return SAVE_PLAIN;
+  if (strcasecmp(dot, ".png") == 0) return SAVE_PNG;
+  if (strcasecmp(dot, ".qoi") == 0) return SAVE_QOI;
+  return SAVE_PLAIN;
+}
+
+/*special_output tells whether path names an output other than a file of*/
+/*its own: "-" for stdout, "fd:N" for an inherited descriptor or*/
+/*"shm:/name" for a shared memory segment*/
+
+int special_output (const char *path)
+{
+  return (strcmp(path, "-") == 0) || (strncmp(path, "fd:", 3) == 0) || (strncmp(path, "shm:", 4) == 0);
+}
+
+/*open_output opens where a SAVE to path goes and returns its descriptor,*/
+/*or -1. A file is created or truncated. Stdout and an inherited descriptor*/
+/*are written from where they are, and only from the command line, since a*/
+/*server or a program using the library has descriptors of its own. A SAVE*/
+/*- of a --serve request goes to the scratch file to be sent back. A shared*/
+/*memory segment is created if needed, flagged as not ready in control,*/
+/*which is mapped, and written from SHM_HEADER on. It is never made smaller,*/
+/*so that a reader that has it mapped can't lose its pages.*/
+
+int open_output (const char *path, scene_ptr sc, shm_control_ptr *control)
+{
+  struct stat info;
+  void *map;
+  char *end;
+  long number;
+  int fd;
+
+  *control = NULL;
+  if ((sc->reply >= 0) && (strcmp(path, "-") == 0))
+    {
+      if ((ftruncate(sc->scratch, 0) != 0) || (lseek(sc->scratch, 0, SEEK_SET) != 0)) return -1;
+      return dup(sc->scratch);
+    }
+  if (((strcmp(path, "-") == 0) || (strncmp(path, "fd:", 3) == 0)) && !sc->options.streams) return -1;
+  if (strcmp(path, "-") == 0) return dup(STDOUT_FILENO);
+  if (strncmp(path, "fd:", 3) == 0)
+    {
+      number = strtol(path + 3, &end, 10);
+      if ((end == path + 3) || (*end != '\0') || (number < 0) || (number > INT_MAX)) return -1;
+      return dup((int) number);
+    }
+  if (strncmp(path, "shm:", 4) != 0) return open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+  fd = shm_open(path + 4, O_RDWR | O_CREAT, 0666);
+  if (fd < 0) return -1;
+  map = MAP_FAILED;
+  if ((fstat(fd, &info) == 0) && ((info.st_size >= SHM_HEADER) || (ftruncate(fd, SHM_HEADER) == 0)))
+    map = mmap(NULL, SHM_HEADER, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if ((map == MAP_FAILED) || (lseek(fd, SHM_HEADER, SEEK_SET) != SHM_HEADER))
+    {
+      if (map != MAP_FAILED) munmap(map, SHM_HEADER);
+      close(fd);
+      return -1;
+    }
+  *control = map;
+  (*control)->magic = SHM_MAGIC;
+  (*control)->version = SHM_VERSION;
+  __atomic_store_n(&(*control)->ready, 0, __ATOMIC_RELEASE);
+  return fd;
+}
+
+/*save_image draws the scene into the file path, or one of the outputs of*/
+/*special_output, as a bitmap written or mapped, run-length encoded, or as*/
+/*a PNG or QOI image. The word after the name decides, then the extension*/
+/*of the name, then the options.*/
+
+int save_image (const char *path, int mode, scene_ptr sc)
+{
+  int fd = -1, error = NO_ERROR, partial = 0, streamed;
+  canvas_ptr cv = &sc->cv;
+  shm_control_ptr control = NULL;
+  double start = 0, opened = 0, drawn = 0;
+  off_t before = 0, begun = -1;
+  struct stat info;
+
+  /*stdout and an inherited descriptor are written in order, never sought*/
+  streamed = ((strcmp(path, "-") == 0) && (sc->reply < 0)) || (strncmp(path, "fd:", 3) == 0);
+  if (mode == SAVE_PLAIN) mode = path_format(path);
+  if (mode == SAVE_PLAIN) mode = sc->options.format;
+  if ((mode == SAVE_PLAIN) && sc->options.mapped) mode = SAVE_MMAP;
+  if (sc->stats != NULL)
+    {
+      start = stats_clock();
+      if (sc->anim != NULL) before = lseek(sc->anim->fd, 0, SEEK_CUR);
+    }
+
+  /*in an animation the picture becomes a frame instead of a file*/
+  if (sc->anim == NULL)
+    {
+      fd = open_output (path, sc, &control);
+      if (fd < 0) return ERR_CREATEFILE;
+      if (special_output(path))
+	{
+	  /*only a file of its own can be mapped*/
+	  if (mode == SAVE_MMAP) mode = SAVE_PLAIN;
+	  begun = lseek(fd, 0, SEEK_CUR);
+	}
+    }
+
+  if (!pool_compact(&sc->points) || !pool_compact(&sc->lines) || !pool_compact(&sc->boxes) || !pool_compact(&sc->circles))
+    {
+      if (control != NULL) munmap(control, SHM_HEADER);
+      if (fd >= 0) close(fd);
+      return ERR_MEMORY;
+    }
+  if (sc->stats != NULL) opened = stats_clock();
+
+  if ((sc->anim == NULL) && (mode == SAVE_MMAP))
+    {
+      /*drawing and writing are one step here, timed as drawing*/
+      error = save_mapped (fd, sc);
+      if (sc->stats != NULL) drawn = stats_clock();
+    }
+  else
+    {
+      error = draw_scene (sc, &partial);
+      if (sc->stats != NULL) drawn = stats_clock();
+      if ((error == NO_ERROR) && (sc->anim != NULL)) error = anim_frame (sc->anim, path, cv);
+      else if ((error == NO_ERROR) && (mode == SAVE_RLE) && streamed) error = write_rle_stream (fd, cv);
+      else if ((error == NO_ERROR) && (mode == SAVE_RLE)) error = write_rle (fd, cv);
+      else if ((error == NO_ERROR) && (mode == SAVE_PNG)) error = write_png (fd, cv);
+      else if ((error == NO_ERROR) && (mode == SAVE_QOI)) error = write_qoi (fd, cv);
+      else if (error == NO_ERROR) error = write_image (fd, cv);
+    }
+  cv->dirty_count = 0;
+  cv->dirty_all = 0;
+
+  if (control != NULL)
+    {
+      /*the picture is complete before it is flagged ready*/
+      if (error == NO_ERROR)
+	{
+	  control->size = lseek(fd, 0, SEEK_CUR) - SHM_HEADER;
+	  control->frame++;
+	  __atomic_store_n(&control->ready, 1, __ATOMIC_RELEASE);
+	}
+      munmap(control, SHM_HEADER);
+    }
+  if ((sc->stats != NULL) && (begun >= 0)) sc->stats->bytes += lseek(fd, 0, SEEK_CUR) - begun;
+  else if ((sc->stats != NULL) && (fd >= 0) && (fstat(fd, &info) == 0)) sc->stats->bytes += info.st_size;
+  if ((fd >= 0) && (close (fd) != 0) && (error == NO_ERROR)) error = ERR_WRITE;
+  if ((error == NO_ERROR) && (sc->reply >= 0)) error = send_reply(sc, path);
+
+  /*opening and closing the file count as writing it*/
+  if (sc->stats != NULL)
+    {
+      sc->stats->saves++;
+      sc->stats->partial += partial;
+      if (fd < 0) sc->stats->bytes += lseek(sc->anim->fd, 0, SEEK_CUR) - before;
+      sc->stats->seconds[STAGE_RENDER] += drawn - opened;
+      sc->stats->seconds[STAGE_ENCODE] += stats_clock() - drawn + (opened - start);
+    }
+
+  return error;
+}
+
+/*draw_scene brings the pixels of the canvas up to date with the scene,*/
+/*drawing only the changed regions when it can, in which case partial is*/
+/*set*/
+
+int draw_scene (scene_ptr sc, int *partial)
+{
+  int error = NO_ERROR;
+
+  *partial = redraw_dirty(sc);
+  if (!*partial)
+    {
+      error = clear_canvas(&sc->cv);
+      if (error == NO_ERROR) render_scene (sc);
+    }
+  return error;
+}
+
+/*render_scene draws every object of the scene onto its cleared canvas. A*/
+/*canvas of more than one tile is drawn a tile at a time, which keeps the*/
+/*pixels being drawn in cache and lets the tiles go to several threads.*/
+
+void render_scene (scene_ptr sc)
+{
+  if ((sc->cv.width > TILE_SIZE) || (sc->cv.height > TILE_SIZE))
+    {
+      if (render_tiles(sc) == NO_ERROR) return;
+    }
+  create_point (&sc->cv, &sc->points);
+  create_line (&sc->cv, &sc->lines, sc->options.legacy);
+  create_box (&sc->cv, &sc->boxes);
+  create_circle (&sc->cv, &sc->circles, sc->options.legacy);
+  create_graph (&sc->cv, &sc->graphs);
+}
+
+/*shape_bounds gives the pixels a shape can touch, a box clipped to the*/
+/*canvas. It returns 0 when the box is off the canvas.*/
+
+int shape_bounds (canvas_ptr cv, pool_ptr p, int kind, int slot, int *x0, int *y0, int *x1, int *y1)
+{
+  int rad;
+
+  switch (kind)
+    {
+    case SHAPE_POINT:
+      *x0 = *x1 = p->coord[PT_X][slot] - 1;
+      *y0 = *y1 = p->coord[PT_Y][slot] - 1;
+      break;
+
+    case SHAPE_LINE:
+      *x0 = p->coord[LN_X1][slot] < p->coord[LN_X2][slot] ? p->coord[LN_X1][slot] : p->coord[LN_X2][slot];
+      *x1 = p->coord[LN_X1][slot] < p->coord[LN_X2][slot] ? p->coord[LN_X2][slot] : p->coord[LN_X1][slot];
+      *y0 = p->coord[LN_Y1][slot] < p->coord[LN_Y2][slot] ? p->coord[LN_Y1][slot] : p->coord[LN_Y2][slot];
+      *y1 = p->coord[LN_Y1][slot] < p->coord[LN_Y2][slot] ? p->coord[LN_Y2][slot] : p->coord[LN_Y1][slot];
+      (*x0)--;
+      (*x1)--;
+      (*y0)--;
+      (*y1)--;
+      break;
+
+    case SHAPE_BOX:
+      *x0 = p->coord[BX_LEFT][slot] - 1;
+      *x1 = p->coord[BX_RIGHT][slot] - 1;
+      *y0 = p->coord[BX_BOTTOM][slot] - 1;
+      *y1 = p->coord[BX_TOP][slot] - 1;
+      break;
+
+    default:
+      /*one more than the radius for the thickened legacy circles*/
+      rad = p->coord[CR_RADIUS][slot] + 1;
+      *x0 = p->coord[CR_X][slot] - 1 - rad;
+      *x1 = p->coord[CR_X][slot] - 1 + rad;
+      *y0 = p->coord[CR_Y][slot] - 1 - rad;
+      *y1 = p->coord[CR_Y][slot] - 1 + rad;
+      break;
+    }
+  if (*x0 < 0) *x0 = 0;
+  if (*y0 < 0) *y0 = 0;
+  if (*x1 > cv->width - 1) *x1 = cv->width - 1;
+  if (*y1 > cv->height - 1) *y1 = cv->height - 1;
+  return (*x0 <= *x1) && (*y0 <= *y1);
+}
+
+/*mark_dirty records that the pixels from column x0 to x1 and from row y0 to*/
+/*y1 must be drawn again at the next SAVE. Nothing is recorded while there*/
+/*are no pixels kept to draw over. When the list is full its regions are*/
+/*merged into their bounding box.*/
+
+void mark_dirty (canvas_ptr cv, int x0, int y0, int x1, int y1)
+{
+  int *r, count;
+
+  if ((cv->pixels == NULL) || cv->dirty_all) return;
+  for (count = 0; count < cv->dirty_count; count++)
+    {
+      r = cv->dirty[count];
+      if ((r[0] <= x0) && (r[1] <= y0) && (r[2] >= x1) && (r[3] >= y1)) return;
+    }
+  if (cv->dirty_count == DIRTY_MAX)
+    {
+      r = cv->dirty[0];
+      for (count = 1; count < DIRTY_MAX; count++)
+	{
+	  if (cv->dirty[count][0] < r[0]) r[0] = cv->dirty[count][0];
+	  if (cv->dirty[count][1] < r[1]) r[1] = cv->dirty[count][1];
+	  if (cv->dirty[count][2] > r[2]) r[2] = cv->dirty[count][2];
+	  if (cv->dirty[count][3] > r[3]) r[3] = cv->dirty[count][3];
+	}
+      cv->dirty_count = 1;
+    }
+  r = cv->dirty[cv->dirty_count++];
+  r[0] = x0;
+  r[1] = y0;
+  r[2] = x1;
+  r[3] = y1;
+}
+
+/*grid_free releases the cells of a grid, which is then built again when it*/
+/*is next asked about*/
+
+void grid_free (shape_grid *g)
+{
+  int cell;
+
+  if (g->cells != NULL)
+    {
+      for (cell = 0; cell <= g->columns * g->rows; cell++) free(g->cells[cell].entries);
+    }
+  free(g->cells);
+  free(g->found);
+  memset(g, 0, sizeof(shape_grid));
+}
+
+/*grid_range gives the cells under a box, or the list of large shapes when*/
+/*there are too many. Returns 0 for the large list.*/
+
+static int grid_range (shape_grid *g, int x0, int y0, int x1, int y1, int *cx0, int *cy0, int *cx1, int *cy1)
+{
+  *cx0 = x0 / GRID_CELL;
+  *cy0 = y0 / GRID_CELL;
+  *cx1 = x1 / GRID_CELL;
+  *cy1 = y1 / GRID_CELL;
+  if ((long long) (*cx1 - *cx0 + 1) * (*cy1 - *cy0 + 1) <= GRID_LARGE) return 1;
+  *cx0 = *cx1 = 0;
+  *cy0 = *cy1 = g->rows;
+  return 0;
+}
+
+/*grid_add lists a shape under every cell its bounding box meets. Returns 0*/
+/*if memory ran out.*/
+
+static int grid_add (shape_grid *g, int id, int x0, int y0, int x1, int y1)
+{
+  grid_cell *cell;
+  grid_entry *entries;
+  int cx0, cy0, cx1, cy1, cx, cy, capacity;
+
+  grid_range(g, x0, y0, x1, y1, &cx0, &cy0, &cx1, &cy1);
+  for (cy = cy0; cy <= cy1; cy++)
+    for (cx = cx0; cx <= cx1; cx++)
+      {
+	cell = &g->cells[cy * g->columns + cx];
+	if (cell->count == cell->capacity)
+	  {
+	    capacity = cell->capacity ? 2 * cell->capacity : 4;
+	    entries = realloc(cell->entries, capacity * sizeof(grid_entry));
+	    if (entries == NULL) return 0;
+	    cell->entries = entries;
+	    cell->capacity = capacity;
+	  }
+	cell->entries[cell->count].x0 = x0;
+	cell->entries[cell->count].y0 = y0;
+	cell->entries[cell->count].x1 = x1;
+	cell->entries[cell->count].y1 = y1;
+	cell->entries[cell->count].id = id;
+	cell->count++;
+      }
+  return 1;
+}
+
+/*grid_drop takes a shape out of every cell its bounding box meets*/
+
+static void grid_drop (shape_grid *g, int id, int x0, int y0, int x1, int y1)
+{
+  grid_cell *cell;
+  int cx0, cy0, cx1, cy1, cx, cy, entry;
+
+  grid_range(g, x0, y0, x1, y1, &cx0, &cy0, &cx1, &cy1);
+  for (cy = cy0; cy <= cy1; cy++)
+    for (cx = cx0; cx <= cx1; cx++)
+      {
+	cell = &g->cells[cy * g->columns + cx];
+	for (entry = 0; entry < cell->count; entry++)
+	  {
+	    if (cell->entries[entry].id != id) continue;
+	    cell->entries[entry] = cell->entries[--cell->count];
+	    break;
+	  }
+      }
+}
+
+/*grid_ready builds the grid of a pool for the current canvas if it isn't*/
+/*built yet, and makes room for a query to find every shape. Returns 0 if*/
+/*memory ran out, leaving no grid.*/
+
+int grid_ready (pool_ptr p, int kind, canvas_ptr cv)
+{
+  shape_grid *g = &p->grid;
+  int slot, x0, y0, x1, y1;
+
+  if ((g->cells != NULL) && ((g->width != cv->width) || (g->height != cv->height))) grid_free(g);
+  if (g->cells == NULL)
+    {
+      g->columns = (cv->width + GRID_CELL - 1) / GRID_CELL;
+      g->rows = (cv->height + GRID_CELL - 1) / GRID_CELL;
+      g->width = cv->width;
+      g->height = cv->height;
+      g->cells = calloc((size_t) g->columns * g->rows + 1, sizeof(grid_cell));
+      if (g->cells == NULL)
+	{
+	  grid_free(g);
+	  return 0;
+	}
+      for (slot = pool_next(p, 0); slot >= 0; slot = pool_next(p, slot + 1))
+	{
+	  if (!shape_bounds(cv, p, kind, slot, &x0, &y0, &x1, &y1)) continue;
+	  if (!grid_add(g, p->id[slot], x0, y0, x1, y1))
+	    {
+	      grid_free(g);
+	      return 0;
+	    }
+	}
+    }
+  if (g->found_capacity < p->live)
+    {
+      free(g->found);
+      g->found = malloc(p->live * sizeof(int));
+      if (g->found == NULL)
+	{
+	  grid_free(g);
+	  return 0;
+	}
+      g->found_capacity = p->live;
+    }
+  return 1;
+}
+
+/*compare_ints orders ints from the smallest*/
+
+static int compare_ints (const void *a, const void *b)
+{
+  int ia = *(const int *) a, ib = *(const int *) b;
+
+  return (ia > ib) - (ia < ib);
+}
+
+/*grid_query puts in grid.found the slots, in increasing order, of the*/
+/*shapes whose bounding box meets the pixels from column x0 to x1 and from*/
+/*row y0 to y1, and returns how many there are. A shape listed under several*/
+/*of the cells is only taken from the cell holding the top left corner of*/
+/*where it meets the rectangle, so each is found once. The grid must have*/
+/*been readied since the last change of canvas size.*/
+
+int grid_query (pool_ptr p, int x0, int y0, int x1, int y1)
+{
+  shape_grid *g = &p->grid;
+  grid_cell *cell;
+  grid_entry *e;
+  int cx0, cy0, cx1, cy1, cx, cy, entry, count = 0;
+
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > g->width - 1) x1 = g->width - 1;
+  if (y1 > g->height - 1) y1 = g->height - 1;
+  if ((x0 > x1) || (y0 > y1)) return 0;
+
+  cx0 = x0 / GRID_CELL;
+  cy0 = y0 / GRID_CELL;
+  cx1 = x1 / GRID_CELL;
+  cy1 = y1 / GRID_CELL;
+  for (cy = cy0; cy <= cy1; cy++)
+    for (cx = cx0; cx <= cx1; cx++)
+      {
+	cell = &g->cells[cy * g->columns + cx];
+	for (entry = 0; entry < cell->count; entry++)
+	  {
+	    e = &cell->entries[entry];
+	    if ((e->x1 < x0) || (e->x0 > x1) || (e->y1 < y0) || (e->y0 > y1)) continue;
+	    if (((e->x0 > x0 ? e->x0 : x0) / GRID_CELL != cx) || ((e->y0 > y0 ? e->y0 : y0) / GRID_CELL != cy)) continue;
+	    g->found[count++] = pool_find(p, e->id);
+	  }
+      }
+  cell = &g->cells[g->columns * g->rows];
+  for (entry = 0; entry < cell->count; entry++)
+    {
+      e = &cell->entries[entry];
+      if ((e->x1 < x0) || (e->x0 > x1) || (e->y1 < y0) || (e->y0 > y1)) continue;
+      g->found[count++] = pool_find(p, e->id);
+    }
+  if (count > 1) qsort(g->found, count, sizeof(int), compare_ints);
+  return count;
+}
+
+/*detach_shape is called before a shape is moved, replaced or deleted. It*/
+/*marks the pixels the shape can touch as changed and takes it out of the*/
+/*grid of its pool.*/
+
+void detach_shape (canvas_ptr cv, pool_ptr p, int kind, int slot)
+{
+  int x0, y0, x1, y1;
+
+  if (((cv->pixels == NULL) || cv->dirty_all) && (p->grid.cells == NULL)) return;
+  if (!shape_bounds(cv, p, kind, slot, &x0, &y0, &x1, &y1)) return;
+  if ((cv->pixels != NULL) && !cv->dirty_all) mark_dirty(cv, x0, y0, x1, y1);
+  if (p->grid.cells == NULL) return;
+  if ((p->grid.width != cv->width) || (p->grid.height != cv->height)) grid_free(&p->grid);
+  else grid_drop(&p->grid, p->id[slot], x0, y0, x1, y1);
+}
+
+/*attach_shape is called once a shape has been added or moved. It marks the*/
+/*pixels the shape can touch as changed and lists it in the grid of its*/
+/*pool. A grid that can't grow is dropped and built again when needed.*/
+
+void attach_shape (canvas_ptr cv, pool_ptr p, int kind, int slot)
+{
+  int x0, y0, x1, y1;
+
+  if (((cv->pixels == NULL) || cv->dirty_all) && (p->grid.cells == NULL)) return;
+  if (!shape_bounds(cv, p, kind, slot, &x0, &y0, &x1, &y1)) return;
+  if ((cv->pixels != NULL) && !cv->dirty_all) mark_dirty(cv, x0, y0, x1, y1);
+  if (p->grid.cells == NULL) return;
+  if ((p->grid.width != cv->width) || (p->grid.height != cv->height) || !grid_add(&p->grid, p->id[slot], x0, y0, x1, y1))
+    grid_free(&p->grid);
+}
+
+/*place_shape returns the slot of an object like pool_insert, first taking*/
+/*out the object it replaces*/
+
+int place_shape (canvas_ptr cv, pool_ptr p, int kind, int id)
+{
+  int slot;
+
+  slot = pool_find(p, id);
+  if (slot >= 0) detach_shape(cv, p, kind, slot);
+  return pool_insert(p, id);
+}
+
+/*remove_shape deletes an object like pool_remove, also taking it out of*/
+/*the grid and marking its pixels as changed*/
+
+void remove_shape (canvas_ptr cv, pool_ptr p, int kind, int id)
+{
+  int slot;
+
+  slot = pool_find(p, id);
+  if (slot < 0) return;
+  detach_shape(cv, p, kind, slot);
+  pool_remove(p, id);
+}
+
+/*draw_shape draws the shape in slot of a pool of the given kind*/
+
+void draw_shape (canvas_ptr cv, pool_ptr p, int kind, int slot, int legacy)
+{
+  switch (kind)
+    {
+    case SHAPE_POINT:
+      if (IN_CLIP(cv, p->coord[PT_X][slot] - 1, p->coord[PT_Y][slot] - 1))
+	{
+	  PIXEL(cv, p->coord[PT_X][slot] - 1, p->coord[PT_Y][slot] - 1) = p->color[slot];
+	  if (cv->drawn != NULL) cv->drawn[SHAPE_POINT]++;
+	}
+      break;
+
+    case SHAPE_LINE:
+      if (legacy)
+	draw_line_legacy (cv, p->coord[LN_X1][slot] - 1, p->coord[LN_Y1][slot] - 1,
+			  p->coord[LN_X2][slot] - 1, p->coord[LN_Y2][slot] - 1, p->color[slot]);
+      else
+	draw_line (cv, p->coord[LN_X1][slot] - 1, p->coord[LN_Y1][slot] - 1,
+		   p->coord[LN_X2][slot] - 1, p->coord[LN_Y2][slot] - 1, p->color[slot]);
+      break;
+
+    case SHAPE_BOX:
+      draw_box (cv, p->coord[BX_LEFT][slot] - 1, p->coord[BX_TOP][slot] - 1,
+		p->coord[BX_RIGHT][slot] - 1, p->coord[BX_BOTTOM][slot] - 1, p->color[slot]);
+      break;
+
+    default:
+      if (legacy)
+	draw_circle_legacy (cv, p->coord[CR_X][slot] - 1, p->coord[CR_Y][slot] - 1,
+			    p->coord[CR_RADIUS][slot], p->color[slot]);
+      else
+	draw_disc (cv, p->coord[CR_X][slot] - 1, p->coord[CR_Y][slot] - 1,
+		   p->coord[CR_RADIUS][slot], p->color[slot]);
+      break;
+    }
+}
+
+#ifdef IDRAW_BENCH
+
+/*bench_random steps a small generator for the benchmarks*/
+
+static unsigned int bench_random (unsigned int *seed, unsigned int range)
+{
+  *seed = *seed * 1103515245u + 12345u;
+  return (*seed >> 8) % range;
+}
+
+/*bench_box puts box id at a random place, up to 32 pixels a side*/
+
+static void bench_box (pool_ptr p, int slot, unsigned int *seed, int side)
+{
+  p->coord[BX_LEFT][slot] = 1 + bench_random(seed, side - 32);
+  p->coord[BX_BOTTOM][slot] = 1 + bench_random(seed, side - 32);
+  p->coord[BX_RIGHT][slot] = p->coord[BX_LEFT][slot] + bench_random(seed, 32);
+  p->coord[BX_TOP][slot] = p->coord[BX_BOTTOM][slot] + bench_random(seed, 32);
+  p->color[slot] = 1;
+}
+
+/*scene_kinds names the scenes the generators make, each made mostly of one*/
+/*kind of command*/
+
+static const char *scene_kinds[SCENE_KINDS] = { "points", "lines", "boxes", "circles", "graph", "churn" };
+
+/*scene_kind gives the number of the scene called name, or -1*/
+
+int scene_kind (const char *name)
+{
+  int kind;
+
+  for (kind = 0; kind < SCENE_KINDS; kind++)
+    if (strcmp(name, scene_kinds[kind]) == 0) return kind;
+  return -1;
+}
+
+/*gen_scene writes a script of count shapes of one kind, or count columns*/
+/*of a graph, to out. The same kind and count always give the same script.*/
+/*A graph scene reads its samples from the file data, which gen_graph makes.*/
+/*A churn scene adds count boxes and circles, then moves, deletes and adds*/
+/*them back 5 * count times.*/
+
+int gen_scene (FILE *out, int kind, int count, const char *data)
+{
+  unsigned int seed = 1;
+  int n, id, x, y, side = SCENE_SIDE;
+
+  if (kind == SCENE_GRAPH)
+    {
+      fprintf (out, "SIZE %d,%d\nGRAP %s,3\n", (count < CANVAS_MAX) ? count : CANVAS_MAX, side / 2, data);
+      return ferror(out) ? ERR_WRITE : NO_ERROR;
+    }
+  fprintf (out, "SIZE %d,%d\n", side, side);
+  for (n = 1; n <= count; n++)
+    {
+      x = 1 + bench_random(&seed, side);
+      y = 1 + bench_random(&seed, side);
+      switch (kind)
+	{
+	case SCENE_POINTS:
+	  fprintf (out, "P%d %d,%d,%d\n", n, x, y, 1 + n % 4);
+	  break;
+
+	case SCENE_LINES:
+	  fprintf (out, "L%d %d,%d,%d,%d,%d\n", n, x, y, 1 + bench_random(&seed, side), 1 + bench_random(&seed, side), 1 + n % 4);
+	  break;
+
+	case SCENE_BOXES:
+	case SCENE_CHURN:
+	  x = 1 + bench_random(&seed, side - 128);
+	  y = 129 + bench_random(&seed, side - 128);
+	  fprintf (out, "B%d %d,%d,%d,%d,%d\n", n, x, y, x + bench_random(&seed, 128), y - bench_random(&seed, 128), 1 + n % 4);
+	  if (kind == SCENE_BOXES) break;
+	  /* fall through */
+
+	case SCENE_CIRCLES:
+	  fprintf (out, "C%d %d,%d,%d,%d\n", n, x, y, bench_random(&seed, 64), 1 + n % 4);
+	  break;
+	}
+    }
+
+  /*the churn: mostly moves, some deletes, and shapes added back*/
+  for (n = 0; (kind == SCENE_CHURN) && (n < 5 * count); n++)
+    {
+      id = 1 + bench_random(&seed, count);
+      x = 130 + bench_random(&seed, side - 260);
+      y = 130 + bench_random(&seed, side - 260);
+      switch (bench_random(&seed, 10))
+	{
+	case 0:
+	  fprintf (out, "DELT %c%d\n", (n & 1) ? 'B' : 'C', id);
+	  break;
+
+	case 1:
+	  if (n & 1) fprintf (out, "B%d %d,%d,%d,%d,%d\n", id, x, y, x + 60, y - 60, 1 + n % 4);
+	  else fprintf (out, "C%d %d,%d,%d,%d\n", id, x, y, bench_random(&seed, 64), 1 + n % 4);
+	  break;
+
+	default:
+	  fprintf (out, "MOVE %c%d,%d,%d,%d\n", (n & 1) ? 'B' : 'C', id, x, y, 1 + n % 4);
+	  break;
+	}
+    }
+  return ferror(out) ? ERR_WRITE : NO_ERROR;
+}
+
+/*gen_graph writes count samples of two summed sine waves to the file path*/
+/*for a graph scene*/
+
+int gen_graph (const char *path, int count)
+{
+  FILE *out;
+  float sample;
+  int n, error = NO_ERROR;
+
+  out = fopen(path, "wb");
+  if (out == NULL) return ERR_CREATEFILE;
+  for (n = 0; (n < count) && (error == NO_ERROR); n++)
+    {
+      sample = (float) (0.6 * sin(n * 0.01) + 0.3 * sin(n * 0.37));
+      if (fwrite(&sample, sizeof(float), 1, out) != 1) error = ERR_WRITE;
+    }
+  if ((fclose(out) != 0) && (error == NO_ERROR)) error = ERR_WRITE;
+  return error;
+}
+
+/*bench_seconds gives the seconds from start until now*/
+
+static double bench_seconds (struct timespec *start)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/*bench_scene runs the script text of one generated scene and times, best*/
+/*of 3 runs each: reading it into a new scene, drawing each kind of shape*/
+/*on its own, drawing the whole scene as a SAVE does, and writing the*/
+/*bitmap. It prints one JSON object and a comma unless last is set.*/
+
+static int bench_scene (int kind, int count, char *text, size_t size, int last)
+{
+  static const char *shapes[5] = { "point", "line", "box", "circle", "graph" };
+  double best[9], seconds;
+  struct timespec start;
+  script input;
+  scene sc;
+  FILE *file;
+  int round, phase, error = NO_ERROR;
+
+  file = tmpfile();
+  if (file == NULL) return ERR_CREATEFILE;
+  for (phase = 0; phase < 9; phase++) best[phase] = 1e30;
+  initialize_scene (&sc);
+  for (round = 0; (round < 3) && (error == NO_ERROR); round++)
+    {
+      /*reading: tokenizing, checking and storing every command*/
+      release_scene (&sc);
+      initialize_scene (&sc);
+      memset(&input, 0, sizeof(script));
+      input.data = text;
+      input.size = size;
+      input.eof = 1;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      error = interpret (&input, &sc);
+      if (error == NO_ERROR) error = (pool_compact(&sc.points) && pool_compact(&sc.lines) && pool_compact(&sc.boxes)
+				      && pool_compact(&sc.circles)) ? NO_ERROR : ERR_MEMORY;
+      seconds = bench_seconds(&start);
+      if (seconds < best[0]) best[0] = seconds;
+
+      /*each kind of shape drawn on its own onto a cleared canvas*/
+      for (phase = 1; (phase < 6) && (error == NO_ERROR); phase++)
+	{
+	  error = clear_canvas(&sc.cv);
+	  clock_gettime(CLOCK_MONOTONIC, &start);
+	  if (phase == 1) create_point (&sc.cv, &sc.points);
+	  else if (phase == 2) create_line (&sc.cv, &sc.lines, 0);
+	  else if (phase == 3) create_box (&sc.cv, &sc.boxes);
+	  else if (phase == 4) create_circle (&sc.cv, &sc.circles, 0);
+	  else create_graph (&sc.cv, &sc.graphs);
+	  seconds = bench_seconds(&start);
+	  if (seconds < best[phase]) best[phase] = seconds;
+	}
+
+      /*the whole scene, cleared and drawn in tiles on every thread*/
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (error == NO_ERROR) error = clear_canvas(&sc.cv);
+      if (error == NO_ERROR) render_scene (&sc);
+      seconds = bench_seconds(&start);
+      if (seconds < best[6]) best[6] = seconds;
+
+      /*writing the bitmap*/
+      if ((error == NO_ERROR) && ((ftruncate(fileno(file), 0) != 0) || (lseek(fileno(file), 0, SEEK_SET) != 0))) error = ERR_WRITE;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      if (error == NO_ERROR) error = write_image (fileno(file), &sc.cv);
+      seconds = bench_seconds(&start);
+      if (seconds < best[7]) best[7] = seconds;
+    }
+
+  if (error == NO_ERROR)
+    {
+      printf ("  {\"scene\": \"%s\", \"count\": %d, \"width\": %d, \"height\": %d, \"script_bytes\": %lu, \"parse_ms\": %.3f, \"raster_ms\": {",
+	      scene_kinds[kind], count, sc.cv.width, sc.cv.height, (unsigned long) size, best[0] * 1e3);
+      for (phase = 1; phase < 6; phase++) printf ("\"%s\": %.3f%s", shapes[phase - 1], best[phase] * 1e3, (phase < 5) ? ", " : "");
+      printf ("}, \"render_ms\": %.3f, \"encode_ms\": %.3f}%s\n", best[6] * 1e3, best[7] * 1e3, last ? "" : ",");
+    }
+  release_scene (&sc);
+  fclose(file);
+  return error;
+}
+
+/*bench_scenes generates each kind of scene at scale times its base size*/
+/*and times it with bench_scene, printing the results as JSON*/
+
+int bench_scenes (int scale)
+{
+  static const int counts[SCENE_KINDS] = { 200000, 20000, 20000, 20000, 8192, 10000 };
+  char data[32] = "/tmp/idraw-XXXXXX";
+  char *text = NULL;
+  size_t size;
+  FILE *out;
+  int kind, count, fd, error = NO_ERROR;
+
+  if (scale < 1) scale = 1;
+  fd = mkstemp(data);
+  if (fd < 0) return ERR_CREATEFILE;
+  close(fd);
+
+  printf ("{\"bench\": \"scenes\", \"scale\": %d, \"results\": [\n", scale);
+  for (kind = 0; (kind < SCENE_KINDS) && (error == NO_ERROR); kind++)
+    {
+      count = counts[kind] * scale;
+      if (kind == SCENE_GRAPH) error = gen_graph(data, (count < CANVAS_MAX) ? count : CANVAS_MAX);
+      out = open_memstream(&text, &size);
+      if (out == NULL) error = ERR_MEMORY;
+      if (error == NO_ERROR) error = gen_scene(out, kind, count, data);
+      if ((out != NULL) && (fclose(out) != 0) && (error == NO_ERROR)) error = ERR_MEMORY;
+      if (error == NO_ERROR) error = bench_scene(kind, count, text, size, kind == SCENE_KINDS - 1);
+      free(text);
+      text = NULL;
+    }
+  if (error == NO_ERROR) printf ("]}\n");
+  unlink(data);
+  return error;
+}
+
+/*bench_grid times the grid on 10^4 to 10^6 small boxes on a 8192x8192*/
+/*canvas: adding the boxes, moving them, and finding the boxes under 256x256*/
+/*rectangles, against checking every box, and prints the times as JSON*/
+
+int bench_grid (void)
+{
+  static const int sizes[] = { 10000, 100000, 1000000 };
+  scene sc;
+  pool_ptr p = &sc.boxes;
+  struct timespec start, end;
+  double seconds[4];
+  long long found, scanned;
+  unsigned int seed;
+  int size, count, slot, query, x0, y0, x1, y1, bx0, by0, bx1, by1, error = NO_ERROR;
+
+  printf ("{\"bench\": \"grid\", \"results\": [\n");
+  for (size = 0; (size < (int) (sizeof(sizes) / sizeof(sizes[0]))) && (error == NO_ERROR); size++)
+    {
+      initialize_scene (&sc);
+      resize_canvas (&sc.cv, 8192, 8192);
+      if (!grid_ready(p, SHAPE_BOX, &sc.cv)) error = ERR_MEMORY;
+
+      /*adding*/
+      seed = 1;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (count = 0; (count < sizes[size]) && (error == NO_ERROR); count++)
+	{
+	  slot = place_shape(&sc.cv, p, SHAPE_BOX, count);
+	  if (slot < 0)
+	    {
+	      error = ERR_MEMORY;
+	      break;
+	    }
+	  bench_box (p, slot, &seed, 8192);
+	  attach_shape (&sc.cv, p, SHAPE_BOX, slot);
+	}
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      seconds[0] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+      /*moving 100000 boxes*/
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (count = 0; (count < 100000) && (error == NO_ERROR); count++)
+	{
+	  slot = pool_find(p, bench_random(&seed, sizes[size]));
+	  detach_shape (&sc.cv, p, SHAPE_BOX, slot);
+	  bench_box (p, slot, &seed, 8192);
+	  attach_shape (&sc.cv, p, SHAPE_BOX, slot);
+	}
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      seconds[1] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+      if ((error == NO_ERROR) && !grid_ready(p, SHAPE_BOX, &sc.cv)) error = ERR_MEMORY;
+
+      /*200 queries through the grid, then the same ones checking every box*/
+      found = scanned = 0;
+      for (query = 0; (query < 400) && (error == NO_ERROR); query++)
+	{
+	  if ((query == 0) || (query == 200))
+	    {
+	      seed = 7;
+	      clock_gettime(CLOCK_MONOTONIC, &start);
+	    }
+	  x0 = bench_random(&seed, 8192 - 256);
+	  y0 = bench_random(&seed, 8192 - 256);
+	  x1 = x0 + 255;
+	  y1 = y0 + 255;
+	  if (query < 200) found += grid_query(p, x0, y0, x1, y1);
+	  else
+	    {
+	      for (slot = pool_next(p, 0); slot >= 0; slot = pool_next(p, slot + 1))
+		{
+		  if (!shape_bounds(&sc.cv, p, SHAPE_BOX, slot, &bx0, &by0, &bx1, &by1)) continue;
+		  if ((bx1 >= x0) && (bx0 <= x1) && (by1 >= y0) && (by0 <= y1)) scanned++;
+		}
+	    }
+	  if ((query == 199) || (query == 399))
+	    {
+	      clock_gettime(CLOCK_MONOTONIC, &end);
+	      seconds[2 + query / 200] = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	    }
+	}
+      if ((error == NO_ERROR) && (found != scanned))
+	{
+	  printf ("ERROR: grid found %lld boxes where there are %lld!\n", found, scanned);
+	  error = ERR_WRITE;
+	}
+      if (error == NO_ERROR)
+	printf ("  {\"objects\": %d, \"insert_ns\": %.1f, \"move_ns\": %.1f, \"query_us\": %.2f, \"scan_us\": %.2f, \"found_per_query\": %.1f}%s\n",
+		sizes[size], seconds[0] * 1e9 / sizes[size], seconds[1] * 1e9 / 100000, seconds[2] * 1e6 / 200, seconds[3] * 1e6 / 200,
+		found / 200.0, (size + 1 < (int) (sizeof(sizes) / sizeof(sizes[0]))) ? "," : "");
+      release_scene (&sc);
+    }
+  printf ("]}\n");
+  return error;
+}
+
+/*bench_save times every way of writing a 4000x4000 picture of 40000 small*/
+/*boxes to a temporary file, and prints the rates and sizes as JSON*/
+
+int bench_save (void)
+{
+  static const char *names[] = { "bmp", "rle8", "png", "qoi" };
+  int (*writers[4]) (int fd, canvas_ptr cv) = { write_image, write_rle, write_png, write_qoi };
+  scene sc;
+  struct timespec start, end;
+  double seconds;
+  FILE *file;
+  off_t size = 0;
+  unsigned int seed = 1;
+  int kind, count, slot, fd, rounds, error = NO_ERROR;
+
+  initialize_scene (&sc);
+  if ((resize_canvas (&sc.cv, 4000, 4000) != NO_ERROR) || ((file = tmpfile()) == NULL))
+    {
+      release_scene (&sc);
+      return ERR_MEMORY;
+    }
+  fd = fileno(file);
+  for (count = 0; (count < 40000) && (error == NO_ERROR); count++)
+    {
+      slot = place_shape(&sc.cv, &sc.boxes, SHAPE_BOX, count);
+      if (slot < 0) error = ERR_MEMORY;
+      else
+	{
+	  bench_box (&sc.boxes, slot, &seed, 4000);
+	  sc.boxes.color[slot] = 1 + bench_random(&seed, PALETTE_COLORS - 1);
+	}
+    }
+  if (error == NO_ERROR) error = clear_canvas(&sc.cv);
+  if (error == NO_ERROR) render_scene (&sc);
+
+  printf ("{\"bench\": \"save\", \"width\": 4000, \"height\": 4000, \"results\": [\n");
+  for (kind = 0; (kind < 4) && (error == NO_ERROR); kind++)
+    {
+      rounds = 0;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      do
+	{
+	  if ((ftruncate(fd, 0) != 0) || (lseek(fd, 0, SEEK_SET) != 0)) error = ERR_WRITE;
+	  if (error == NO_ERROR) error = writers[kind] (fd, &sc.cv);
+	  rounds++;
+	  clock_gettime(CLOCK_MONOTONIC, &end);
+	  seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	}
+      while ((error == NO_ERROR) && (seconds < 0.5));
+      if (error == NO_ERROR) size = lseek(fd, 0, SEEK_END);
+      if (error == NO_ERROR)
+	printf ("  {\"format\": \"%s\", \"mpixels_per_s\": %.1f, \"bytes\": %lld}%s\n", names[kind],
+		4000.0 * 4000.0 * rounds / seconds * 1e-6, (long long) size, (kind < 3) ? "," : "");
+    }
+  if (error == NO_ERROR) printf ("]}\n");
+  fclose(file);
+  release_scene (&sc);
+  return error;
+}
+
+#endif
+
+/*redraw_dirty brings the kept pixels up to date by clearing the changed*/
+/*regions and drawing again, clipped to each region, the shapes the grids*/
+/*find there. Each kind is drawn over every region before the next kind,*/
+/*in slot order, so each pixel ends up with the color of the last shape*/
+/*covering it, as in a full draw. Returns 0, drawing nothing, when there are*/
+/*no pixels kept, when the regions cover more than half of the canvas, which*/
+/*is quicker drawn whole, or when a grid can't be built.*/
+
+int redraw_dirty (scene_ptr sc)
+{
+  canvas_ptr cv = &sc->cv;
+  canvas view;
+  pool_ptr pools[4];
+  long long area = 0;
+  int *r, kind, found, count, row, entry;
+
+  if ((cv->pixels == NULL) || cv->dirty_all) return 0;
+  for (count = 0; count < cv->dirty_count; count++)
+    {
+      r = cv->dirty[count];
+      area += (long long) (r[2] - r[0] + 1) * (r[3] - r[1] + 1);
+    }
+  if (2 * area > (long long) cv->width * cv->height) return 0;
+
+  pools[SHAPE_POINT] = &sc->points;
+  pools[SHAPE_LINE] = &sc->lines;
+  pools[SHAPE_BOX] = &sc->boxes;
+  pools[SHAPE_CIRCLE] = &sc->circles;
+  for (kind = SHAPE_POINT; kind <= SHAPE_CIRCLE; kind++)
+    {
+      if (!grid_ready(pools[kind], kind, cv)) return 0;
+    }
+
+  for (count = 0; count < cv->dirty_count; count++)
+    {
+      r = cv->dirty[count];
+      for (row = r[1]; row <= r[3]; row++) cv->fill(&PIXEL(cv, r[0], row), 0, r[2] - r[0] + 1);
+    }
+
+  view = *cv;
+  for (kind = SHAPE_POINT; kind <= SHAPE_CIRCLE; kind++)
+    {
+      for (count = 0; count < cv->dirty_count; count++)
+	{
+	  r = cv->dirty[count];
+	  view.clip_x0 = r[0];
+	  view.clip_y0 = r[1];
+	  view.clip_x1 = r[2] + 1;
+	  view.clip_y1 = r[3] + 1;
+	  found = grid_query(pools[kind], r[0], r[1], r[2], r[3]);
+	  for (entry = 0; entry < found; entry++)
+	    draw_shape (&view, pools[kind], kind, pools[kind]->grid.found[entry], sc->options.legacy);
+	}
+    }
+  for (count = 0; count < cv->dirty_count; count++)
+    {
+      r = cv->dirty[count];
+      view.clip_x0 = r[0];
+      view.clip_y0 = r[1];
+      view.clip_x1 = r[2] + 1;
+      view.clip_y1 = r[3] + 1;
+      create_graph (&view, &sc->graphs);
+    }
+  return 1;
+}
+
+/*bin_shapes lists every live shape of pool under each tile its bounding box*/
+/*touches, counting the entries first so each list is one packed array*/
+
+static int bin_shapes (tile_bins_ptr bins, pool_ptr p, int kind)
+{
+  canvas_ptr cv = &bins->sc->cv;
+  long long total = 0;
+  int *start, *fill, tiles, slot, x0, y0, x1, y1, tx, ty;
+
+  tiles = bins->columns * bins->rows;
+  start = calloc(tiles + 1, sizeof(int));
+  if (start == NULL) return ERR_MEMORY;
+  bins->start[kind] = start;
+
+  for (slot = pool_next(p, 0); slot >= 0; slot = pool_next(p, slot + 1))
+    {
+      if (!shape_bounds(cv, p, kind, slot, &x0, &y0, &x1, &y1)) continue;
+      for (ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++)
+	for (tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++) start[ty * bins->columns + tx + 1]++;
+      total += (long long) (y1 / TILE_SIZE - y0 / TILE_SIZE + 1) * (x1 / TILE_SIZE - x0 / TILE_SIZE + 1);
+      if (total > BIN_MAX) return ERR_MEMORY;
+    }
+  for (tx = 0; tx < tiles; tx++) start[tx + 1] += start[tx];
+
+  bins->slots[kind] = malloc((total > 0 ? total : 1) * sizeof(int));
+  fill = malloc(tiles * sizeof(int));
+  if ((bins->slots[kind] == NULL) || (fill == NULL))
+    {
+      free(fill);
+      return ERR_MEMORY;
+    }
+  memcpy(fill, start, tiles * sizeof(int));
+  for (slot = pool_next(p, 0); slot >= 0; slot = pool_next(p, slot + 1))
+    {
+      if (!shape_bounds(cv, p, kind, slot, &x0, &y0, &x1, &y1)) continue;
+      for (ty = y0 / TILE_SIZE; ty <= y1 / TILE_SIZE; ty++)
+	for (tx = x0 / TILE_SIZE; tx <= x1 / TILE_SIZE; tx++) bins->slots[kind][fill[ty * bins->columns + tx]++] = slot;
+    }
+  free(fill);
+  return NO_ERROR;
+}
+
+/*draw_tile draws the shapes binned under one tile, clipped to it, in the*/
+/*same order as a whole-canvas draw: points, lines, boxes, circles, graph.*/
+/*When pixels are counted they go to the thread's own counters, drawn.*/
+
+static void draw_tile (tile_bins_ptr bins, int tile, long long *drawn)
+{
+  scene_ptr sc = bins->sc;
+  canvas view = sc->cv;
+  pool_ptr p;
+  int entry, slot, legacy = sc->options.legacy;
+
+  if (view.drawn != NULL) view.drawn = drawn;
+
+  view.clip_x0 = (tile % bins->columns) * TILE_SIZE;
+  view.clip_y0 = (tile / bins->columns) * TILE_SIZE;
+  view.clip_x1 = (view.clip_x0 + TILE_SIZE < view.width) ? view.clip_x0 + TILE_SIZE : view.width;
+  view.clip_y1 = (view.clip_y0 + TILE_SIZE < view.height) ? view.clip_y0 + TILE_SIZE : view.height;
+
+  p = &sc->points;
+  for (entry = bins->start[0][tile]; entry < bins->start[0][tile + 1]; entry++)
+    {
+      slot = bins->slots[0][entry];
+      PIXEL(&view, p->coord[PT_X][slot] - 1, p->coord[PT_Y][slot] - 1) = p->color[slot];
+    }
+  if (view.drawn != NULL) view.drawn[SHAPE_POINT] += bins->start[0][tile + 1] - bins->start[0][tile];
+
+  p = &sc->lines;
+  for (entry = bins->start[1][tile]; entry < bins->start[1][tile + 1]; entry++)
+    {
+      slot = bins->slots[1][entry];
+      if (legacy)
+	draw_line_legacy (&view, p->coord[LN_X1][slot] - 1, p->coord[LN_Y1][slot] - 1,
+			  p->coord[LN_X2][slot] - 1, p->coord[LN_Y2][slot] - 1, p->color[slot]);
+      else
+	draw_line (&view, p->coord[LN_X1][slot] - 1, p->coord[LN_Y1][slot] - 1,
+		   p->coord[LN_X2][slot] - 1, p->coord[LN_Y2][slot] - 1, p->color[slot]);
+    }
+
+  p = &sc->boxes;
+  for (entry = bins->start[2][tile]; entry < bins->start[2][tile + 1]; entry++)
+    {
+      slot = bins->slots[2][entry];
+      draw_box (&view, p->coord[BX_LEFT][slot] - 1, p->coord[BX_TOP][slot] - 1,
+		p->coord[BX_RIGHT][slot] - 1, p->coord[BX_BOTTOM][slot] - 1, p->color[slot]);
+    }
+
+  p = &sc->circles;
+  for (entry = bins->start[3][tile]; entry < bins->start[3][tile + 1]; entry++)
+    {
+      slot = bins->slots[3][entry];
+      if (legacy)
+	draw_circle_legacy (&view, p->coord[CR_X][slot] - 1, p->coord[CR_Y][slot] - 1,
+			    p->coord[CR_RADIUS][slot], p->color[slot]);
+      else
+	draw_disc (&view, p->coord[CR_X][slot] - 1, p->coord[CR_Y][slot] - 1,
+		   p->coord[CR_RADIUS][slot], p->color[slot]);
+    }
+
+  create_graph (&view, &sc->graphs);
+}
+
+/*tile_worker draws tiles until every tile has been handed out*/
+
+static void *tile_worker (void *arg)
+{
+  tile_bins_ptr bins = arg;
+  long long drawn[SHAPE_KINDS] = { 0 };
+  int tile, kind;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&bins->lock);
+      tile = bins->next++;
+      if ((tile >= bins->columns * bins->rows) && (bins->sc->cv.drawn != NULL))
+	{
+	  for (kind = 0; kind < SHAPE_KINDS; kind++) bins->sc->cv.drawn[kind] += drawn[kind];
+	}
+      pthread_mutex_unlock(&bins->lock);
+      if (tile >= bins->columns * bins->rows) break;
+      draw_tile(bins, tile, drawn);
+    }
+  return NULL;
+}
+
+/*render_tiles splits the canvas into tiles, bins every shape to the tiles*/
+/*its bounding box touches and draws the tiles on the scene's threads. Tiles*/
+/*share no pixels, so the result is the same as drawing the whole canvas at*/
+/*once. It fails without drawing anything if the bins can't be made.*/
+
+int render_tiles (scene_ptr sc)
+{
+  tile_bins bins;
+  pthread_t *threads;
+  int error = NO_ERROR, kind, count, started = 1;
+  pool_ptr pools[4];
+
+  pools[0] = &sc->points;
+  pools[1] = &sc->lines;
+  pools[2] = &sc->boxes;
+  pools[3] = &sc->circles;
+  bins.sc = sc;
+  bins.columns = (sc->cv.width + TILE_SIZE - 1) / TILE_SIZE;
+  bins.rows = (sc->cv.height + TILE_SIZE - 1) / TILE_SIZE;
+  bins.next = 0;
+  for (kind = 0; kind < 4; kind++)
+    {
+      bins.start[kind] = NULL;
+      bins.slots[kind] = NULL;
+    }
+  for (kind = 0; (kind < 4) && (error == NO_ERROR); kind++) error = bin_shapes(&bins, pools[kind], kind);
+
+  threads = NULL;
+  if (error == NO_ERROR)
+    {
+      threads = malloc((sc->options.threads > 1 ? sc->options.threads : 1) * sizeof(pthread_t));
+      if (threads == NULL) error = ERR_MEMORY;
+    }
+  if (error == NO_ERROR)
+    {
+      pthread_mutex_init(&bins.lock, NULL);
+      for (started = 1; started < sc->options.threads; started++)
+	{
+	  if (pthread_create(&threads[started], NULL, tile_worker, &bins) != 0) break;
+	}
+      tile_worker(&bins);
+      for (count = 1; count < started; count++) pthread_join(threads[count], NULL);
+      pthread_mutex_destroy(&bins.lock);
+    }
+
+  free(threads);
+  for (kind = 0; kind < 4; kind++)
+    {
+      free(bins.start[kind]);
+      free(bins.slots[kind]);
+    }
+  return error;
+}
+
+/*save_mapped sizes the output file, maps it and draws the scene straight*/
+/*into the pixel area after the header. A freshly sized file reads as zeros,*/
+/*so the canvas needs no clearing, and there is no framebuffer to copy. The*/
+/*heap framebuffer is released so that it does not add to the memory used.*/
+
+int save_mapped (int fd, scene_ptr sc)
+{
+  canvas_ptr cv = &sc->cv;
+  unsigned char *map;
+  size_t size;
+
+  size = BMP_HEADER + (size_t) cv->stride * cv->height;
+  if (ftruncate(fd, size) != 0) return ERR_WRITE;
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) return ERR_WRITE;
+
+  memcpy(map, cv->header, BMP_HEADER);
+  free(cv->pixels);
+  cv->pixels = (char *) map + BMP_HEADER;
+  render_scene (sc);
+  cv->pixels = NULL;
+
+  if (munmap(map, size) != 0) return ERR_WRITE;
+  return NO_ERROR;
+}
+
+/*write_image hands the header and the pixels of the canvas to the file in a*/
+/*single writev call*/
+
+int write_image (int fd, canvas_ptr cv)
+{
+  struct iovec iov[2];
+
+  iov[0].iov_base = cv->header;
+  iov[0].iov_len = BMP_HEADER;
+  iov[1].iov_base = cv->pixels;
+  iov[1].iov_len = (size_t) cv->stride * cv->height;
+  return write_parts (fd, iov, 2);
+}
+
+/*run_length counts the pixels from x on that have the color of pixel x, up*/
+/*to 255, comparing 8 at a time*/
+
+static int run_length (const unsigned char *row, int x, int width)
+{
+  unsigned long long word, same = 0x0101010101010101ULL * row[x];
+  int start = x, end = (width - x > 255) ? x + 255 : width;
+
+  while (x + 8 <= end)
+    {
+      memcpy(&word, row + x, 8);
+      if (word != same) break;
+      x += 8;
+    }
+  while ((x < end) && (row[x] == row[start])) x++;
+  return x - start;
+}
+
+/*rle_row encodes one row of pixels with BI_RLE8 and an end of line, and*/
+/*returns the bytes used, at most 2 * width + 2. Runs of 3 or more pixels of*/
+/*one color are stored as a count and the color; the pixels between them go*/
+/*in absolute runs of up to 255, or as single counts when there are fewer*/
+/*than 3, which absolute mode can't hold.*/
+
+static size_t rle_row (const unsigned char *row, int width, unsigned char *out)
+{
+  size_t used = 0;
+  int x = 0, start, run, count;
+
+  while (x < width)
+    {
+      run = run_length(row, x, width);
+      if (run >= 3)
+	{
+	  out[used++] = run;
+	  out[used++] = row[x];
+	  x += run;
+	  continue;
+	}
+
+      start = x;
+      while ((x < width) && (x - start + run <= 255))
+	{
+	  x += run;
+	  if (x < width) run = run_length(row, x, width);
+	  if (run >= 3) break;
+	}
+      count = x - start;
+      if (count >= 3)
+	{
+	  out[used++] = 0;
+	  out[used++] = count;
+	  memcpy(out + used, row + start, count);
+	  used += count;
+	  if (count & 1) out[used++] = 0;
+	}
+      else
+	{
+	  for (; start < x; start += run)
+	    {
+	      run = run_length(row, start, x);
+	      out[used++] = run;
+	      out[used++] = row[start];
+	    }
+	}
+    }
+  out[used++] = 0;
+  out[used++] = 0;
+  return used;
+}
+
+/*rle_bitmap writes the canvas as a BI_RLE8 bitmap. When it may seek, the*/
+/*rows are encoded a block at a time after room for the header, which is*/
+/*written last once the size of the data is known. Otherwise, or when fd*/
+/*can't seek, the whole bitmap is encoded in memory first and written after*/
+/*its header.*/
+
+static int rle_bitmap (int fd, canvas_ptr cv, int seek)
+{
+  unsigned char header[BMP_HEADER], *block, *grown;
+  size_t capacity, used = 0, total = 0;
+  struct iovec iov[2];
+  off_t base;
+  int row, seekable, error = NO_ERROR;
+
+  capacity = 2 * (size_t) cv->width + 4;
+  if (capacity < RLE_BLOCK) capacity = RLE_BLOCK;
+  block = malloc(capacity);
+  if (block == NULL) return ERR_MEMORY;
+  base = seek ? lseek(fd, 0, SEEK_CUR) : -1;
+  seekable = (base >= 0) && (lseek(fd, base + BMP_HEADER, SEEK_SET) == base + BMP_HEADER);
+
+  for (row = 0; (row < cv->height) && (error == NO_ERROR); row++)
+    {
+      used += rle_row((unsigned char *) &PIXEL(cv, 0, row), cv->width, block + used);
+      if (row == cv->height - 1)
+	{
+	  /*the end of the bitmap takes the place of the last end of line*/
+	  block[used - 1] = 1;
+	}
+      else if (capacity - used < 2 * (size_t) cv->width + 2)
+	{
+	  if (seekable)
+	    {
+	      iov[0].iov_base = block;
+	      iov[0].iov_len = used;
+	      error = write_parts (fd, iov, 1);
+	      total += used;
+	      used = 0;
+	    }
+	  else
+	    {
+	      grown = realloc(block, 2 * capacity);
+	      if (grown == NULL) error = ERR_MEMORY;
+	      else
+		{
+		  block = grown;
+		  capacity *= 2;
+		}
+	    }
+	}
+    }
+  total += used;
+
+  memcpy(header, cv->header, BMP_HEADER);
+  put_le32 (header + 2, BMP_HEADER + total);  /* File Size */
+  put_le32 (header + 30, 1);                  /* Compression: BI_RLE8 */
+  put_le32 (header + 34, total);              /* Bitmap Data Size */
+  iov[0].iov_base = header;
+  iov[0].iov_len = BMP_HEADER;
+  iov[1].iov_base = block;
+  iov[1].iov_len = used;
+  if ((error == NO_ERROR) && !seekable) error = write_parts (fd, iov, 2);
+  else if (error == NO_ERROR)
+    {
+      error = write_parts (fd, iov + 1, 1);
+      if ((error == NO_ERROR) && (pwrite(fd, header, BMP_HEADER, base) != BMP_HEADER)) error = ERR_WRITE;
+    }
+  free(block);
+  return error;
+}
+
+/*write_rle writes the canvas as a BI_RLE8 bitmap into a file of its own*/
+
+int write_rle (int fd, canvas_ptr cv)
+{
+  return rle_bitmap (fd, cv, 1);
+}
+
+/*write_rle_stream writes the canvas as a BI_RLE8 bitmap to a descriptor*/
+/*that isn't idraw's to seek, such as stdout or an inherited one, header*/
+/*first*/
+
+int write_rle_stream (int fd, canvas_ptr cv)
+{
+  return rle_bitmap (fd, cv, 0);
+}
+
+/*deflate_tables fills the tables shared by the PNG writers: the CRC of*/
+/*each byte and the fixed Huffman code of each literal and length symbol,*/
+/*with its bits reversed as deflate sends them low bit first*/
+
+static unsigned long crc_table[256];
+static unsigned short fixed_code[288];
+static unsigned char fixed_bits[288];
+static unsigned char length_symbol[259];
+static unsigned short length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+					   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static unsigned char length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+					   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static unsigned short distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+					     513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static pthread_once_t deflate_once = PTHREAD_ONCE_INIT;
+
+static void deflate_tables (void)
+{
+  unsigned long c;
+  unsigned int code, reversed;
+  int n, bit, symbol, length;
+
+  for (n = 0; n < 256; n++)
+    {
+      c = n;
+      for (bit = 0; bit < 8; bit++) c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      crc_table[n] = c;
+    }
+  for (symbol = 0; symbol < 288; symbol++)
+    {
+      if (symbol < 144) { code = 0x30 + symbol; length = 8; }
+      else if (symbol < 256) { code = 0x190 + symbol - 144; length = 9; }
+      else if (symbol < 280) { code = symbol - 256; length = 7; }
+      else { code = 0xC0 + symbol - 280; length = 8; }
+      reversed = 0;
+      for (bit = 0; bit < length; bit++) reversed |= ((code >> bit) & 1) << (length - 1 - bit);
+      fixed_code[symbol] = reversed;
+      fixed_bits[symbol] = length;
+    }
+  for (symbol = 0; symbol < 29; symbol++)
+    {
+      for (length = length_base[symbol]; (length <= 258) && ((symbol == 28) || (length < length_base[symbol + 1])); length++)
+	length_symbol[length] = symbol;
+    }
+}
+
+/*crc_update carries the CRC of a PNG chunk over size more bytes*/
+
+static unsigned long crc_update (unsigned long crc, const unsigned char *data, size_t size)
+{
+  while (size-- > 0) crc = crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+static void put_be32 (unsigned char *at, unsigned long value)
+{
+  at[0] = (value >> 24) & 0xFF;
+  at[1] = (value >> 16) & 0xFF;
+  at[2] = (value >> 8) & 0xFF;
+  at[3] = value & 0xFF;
+}
+
+/*png_chunk writes one PNG chunk: its length, type, data and CRC*/
+
+static int png_chunk (int fd, const char *type, const unsigned char *data, size_t size)
+{
+  unsigned char head[8], tail[4];
+  struct iovec iov[3];
+  unsigned long crc;
+
+  put_be32 (head, size);
+  memcpy(head + 4, type, 4);
+  crc = crc_update(0xFFFFFFFFUL, head + 4, 4);
+  crc = crc_update(crc, data, size) ^ 0xFFFFFFFFUL;
+  put_be32 (tail, crc);
+  iov[0].iov_base = head;
+  iov[0].iov_len = 8;
+  iov[1].iov_base = (void *) data;
+  iov[1].iov_len = size;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = 4;
+  return write_parts (fd, iov, 3);
+}
+
+/*png_bits adds count bits to the compressed stream, sending the block as*/
+/*an IDAT chunk when it is full*/
+
+static void png_bits (png_writer_ptr w, unsigned long value, int count)
+{
+  w->bits |= (unsigned long long) value << w->count;
+  w->count += count;
+  while (w->count >= 8)
+    {
+      w->block[w->used++] = w->bits & 0xFF;
+      w->bits >>= 8;
+      w->count -= 8;
+      if (w->used == PNG_BLOCK)
+	{
+	  if (w->error == NO_ERROR) w->error = png_chunk(w->fd, "IDAT", w->block, w->used);
+	  w->used = 0;
+	}
+    }
+}
+
+/*png_match gives the length, up to 258, of the match at distance back*/
+/*from position at of the window, stopping at the end of the current row*/
+
+static int png_match (const unsigned char *window, size_t at, size_t back, size_t end)
+{
+  size_t n = 0, limit = (end - at < 258) ? end - at : 258;
+
+  while ((n < limit) && (window[at + n] == window[at - back + n])) n++;
+  return (int) n;
+}
+
+/*png_start writes the signature, header and palette of a PNG of the canvas*/
+/*and the start of its deflate stream*/
+
+int png_start (png_writer_ptr w, int fd, canvas_ptr cv)
+{
+  static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  unsigned char ihdr[13], plte[3 * PALETTE_COLORS];
+  int color, code, bit;
+
+  pthread_once(&deflate_once, deflate_tables);
+  memset(w, 0, sizeof(png_writer));
+  w->fd = fd;
+  w->error = NO_ERROR;
+  w->row_length = (size_t) cv->width + 1;
+  w->adler_a = 1;
+  w->block = malloc(PNG_BLOCK);
+  w->window = malloc(2 * w->row_length);
+  if ((w->block == NULL) || (w->window == NULL)) return ERR_MEMORY;
+
+  /*matches reach back 1 byte or one row, the row only when it's in range*/
+  if (w->row_length <= 32768)
+    {
+      for (code = 29; distance_base[code] > w->row_length; code--);
+      for (bit = 0; bit < 5; bit++) w->row_code |= ((code >> bit) & 1) << (4 - bit);
+      w->row_extra_bits = (code < 4) ? 0 : code / 2 - 1;
+      w->row_extra = w->row_length - distance_base[code];
+    }
+
+  put_be32 (ihdr, cv->width);
+  put_be32 (ihdr + 4, cv->height);
+  ihdr[8] = 8;   /* Bit Depth */
+  ihdr[9] = 3;   /* Color Type: palette */
+  ihdr[10] = 0;  /* Compression: deflate */
+  ihdr[11] = 0;  /* Filter Method */
+  ihdr[12] = 0;  /* Interlace: none */
+  for (color = 0; color < PALETTE_COLORS; color++)
+    {
+      /*the bitmap palette is stored blue, green, red*/
+      plte[3 * color] = cv->header[54 + 4 * color + 2];
+      plte[3 * color + 1] = cv->header[54 + 4 * color + 1];
+      plte[3 * color + 2] = cv->header[54 + 4 * color];
+    }
+  if (write(fd, signature, 8) != 8) return ERR_WRITE;
+  if ((png_chunk(fd, "IHDR", ihdr, 13) != NO_ERROR) || (png_chunk(fd, "PLTE", plte, sizeof(plte)) != NO_ERROR)) return ERR_WRITE;
+
+  /*zlib header, then one final block of fixed Huffman codes*/
+  w->block[w->used++] = 0x78;
+  w->block[w->used++] = 0x01;
+  png_bits (w, 3, 3);
+  return NO_ERROR;
+}
+
+/*png_row compresses the next row of the picture, top row first. A byte*/
+/*is sent as a match when the bytes from it repeat the byte before it or*/
+/*the row above for at least 3 bytes, and as a literal otherwise.*/
+
+void png_row (png_writer_ptr w, const char *pixels)
+{
+  unsigned char *window = w->window;
+  size_t length = w->row_length, at, end = 2 * length, lowest, done;
+  int one, above, best, symbol;
+
+  window[length] = 0;  /*filter type: none*/
+  memcpy(window + length + 1, pixels, length - 1);
+
+  /*Adler-32 of the uncompressed rows, taken in pieces short enough not to*/
+  /*overflow before the modulo*/
+  for (at = length; at < end; at += done)
+    {
+      done = (end - at < 5552) ? end - at : 5552;
+      for (lowest = at; lowest < at + done; lowest++)
+	{
+	  w->adler_a += window[lowest];
+	  w->adler_b += w->adler_a;
+	}
+      w->adler_a %= 65521;
+      w->adler_b %= 65521;
+    }
+
+  lowest = w->rows ? 0 : length;
+  at = length;
+  while (at < end)
+    {
+      one = (at - 1 >= lowest) ? png_match(window, at, 1, end) : 0;
+      above = (w->rows && (length <= 32768)) ? png_match(window, at, length, end) : 0;
+      best = (above > one) ? above : one;
+      if (best < 3)
+	{
+	  png_bits (w, fixed_code[window[at]], fixed_bits[window[at]]);
+	  at++;
+	  continue;
+	}
+      symbol = length_symbol[best];
+      png_bits (w, fixed_code[257 + symbol], fixed_bits[257 + symbol]);
+      if (length_extra[symbol]) png_bits (w, best - length_base[symbol], length_extra[symbol]);
+      if (above > one)
+	{
+	  png_bits (w, w->row_code, 5);
+	  if (w->row_extra_bits) png_bits (w, w->row_extra, w->row_extra_bits);
+	}
+      else png_bits (w, 0, 5);
+      at += best;
+    }
+  memcpy(window, window + length, length);
+  w->rows++;
+}
+
+/*png_finish ends the deflate stream with its Adler-32, sends what is left*/
+/*of it and ends the file, then frees the writer*/
+
+int png_finish (png_writer_ptr w)
+{
+  unsigned char adler[4];
+  int error;
+
+  png_bits (w, fixed_code[256], fixed_bits[256]);
+  if (w->count > 0) png_bits (w, 0, 8 - w->count);
+  put_be32 (adler, (w->adler_b << 16) | w->adler_a);
+  for (error = 0; error < 4; error++) png_bits (w, adler[error], 8);
+  error = w->error;
+  if ((error == NO_ERROR) && (w->used > 0)) error = png_chunk(w->fd, "IDAT", w->block, w->used);
+  if (error == NO_ERROR) error = png_chunk(w->fd, "IEND", NULL, 0);
+  free(w->block);
+  free(w->window);
+  w->block = NULL;
+  w->window = NULL;
+  return error;
+}
+
+/*write_png writes the canvas as a palette PNG, a row at a time*/
+
+int write_png (int fd, canvas_ptr cv)
+{
+  png_writer w;
+  int row, error;
+
+  error = png_start (&w, fd, cv);
+  for (row = cv->height - 1; (row >= 0) && (error == NO_ERROR); row--) png_row (&w, &PIXEL(cv, 0, row));
+  if (error == NO_ERROR) return png_finish (&w);
+  free(w.block);
+  free(w.window);
+  return error;
+}
+
+/*qoi_flush writes out the bytes waiting in a QOI writer*/
+
+static int qoi_flush (qoi_writer_ptr w)
+{
+  struct iovec iov;
+
+  iov.iov_base = w->block;
+  iov.iov_len = w->used;
+  w->used = 0;
+  return write_parts (w->fd, &iov, 1);
+}
+
+/*qoi_start writes the header of a QOI image of the canvas*/
+
+int qoi_start (qoi_writer_ptr w, int fd, canvas_ptr cv)
+{
+  int color;
+
+  memset(w, 0, sizeof(qoi_writer));
+  w->fd = fd;
+  w->width = cv->width;
+  w->capacity = QOI_BLOCK + 4 * (size_t) cv->width + 16;
+  w->block = malloc(w->capacity);
+  if (w->block == NULL) return ERR_MEMORY;
+
+  /*every palette entry as red, green, blue, alpha in one int*/
+  for (color = 0; color < 256; color++)
+    {
+      w->palette[color] = ((unsigned int) cv->header[54 + 4 * color + 2] << 24) | ((unsigned int) cv->header[54 + 4 * color + 1] << 16)
+	| ((unsigned int) cv->header[54 + 4 * color] << 8) | 0xFF;
+    }
+  w->previous = 0xFF;
+
+  memcpy(w->block, "qoif", 4);
+  put_be32 (w->block + 4, cv->width);
+  put_be32 (w->block + 8, cv->height);
+  w->block[12] = 3;  /* Channels: RGB */
+  w->block[13] = 0;  /* Colorspace: sRGB */
+  w->used = 14;
+  return NO_ERROR;
+}
+
+/*qoi_row encodes the next row of the picture, top row first. Runs of one*/
+/*palette index are counted several pixels at a time.*/
+
+int qoi_row (qoi_writer_ptr w, const char *pixels)
+{
+  const unsigned char *row = (const unsigned char *) pixels;
+  unsigned int color, hash;
+  int x = 0, run, dr, dg, db;
+
+  while (x < w->width)
+    {
+      color = w->palette[row[x]];
+      if (color == w->previous)
+	{
+	  run = run_length(row, x, w->width);
+	  w->run += run;
+	  x += run;
+	  while (w->run >= 62)
+	    {
+	      w->block[w->used++] = 0xC0 | 61;
+	      w->run -= 62;
+	    }
+	  continue;
+	}
+      if (w->run > 0)
+	{
+	  w->block[w->used++] = 0xC0 | (w->run - 1);
+	  w->run = 0;
+	}
+
+      hash = ((color >> 24) * 3 + ((color >> 16) & 0xFF) * 5 + ((color >> 8) & 0xFF) * 7 + 255 * 11) % 64;
+      if (w->index[hash] == color) w->block[w->used++] = hash;
+      else
+	{
+	  w->index[hash] = color;
+	  dr = (signed char) ((color >> 24) - (w->previous >> 24));
+	  dg = (signed char) (((color >> 16) & 0xFF) - ((w->previous >> 16) & 0xFF));
+	  db = (signed char) (((color >> 8) & 0xFF) - ((w->previous >> 8) & 0xFF));
+	  if ((dr >= -2) && (dr <= 1) && (dg >= -2) && (dg <= 1) && (db >= -2) && (db <= 1))
+	    w->block[w->used++] = 0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+	  else if ((dg >= -32) && (dg <= 31) && (dr - dg >= -8) && (dr - dg <= 7) && (db - dg >= -8) && (db - dg <= 7))
+	    {
+	      w->block[w->used++] = 0x80 | (dg + 32);
+	      w->block[w->used++] = ((dr - dg + 8) << 4) | (db - dg + 8);
+	    }
+	  else
+	    {
+	      w->block[w->used++] = 0xFE;
+	      w->block[w->used++] = color >> 24;
+	      w->block[w->used++] = (color >> 16) & 0xFF;
+	      w->block[w->used++] = (color >> 8) & 0xFF;
+	    }
+	}
+      w->previous = color;
+      x++;
+    }
+  if (w->capacity - w->used < 4 * (size_t) w->width + 16) return qoi_flush(w);
+  return NO_ERROR;
+}
+
+/*qoi_finish ends the last run and the file, then frees the writer*/
+
+int qoi_finish (qoi_writer_ptr w)
+{
+  static const unsigned char end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+  int error;
+
+  if (w->run > 0) w->block[w->used++] = 0xC0 | (w->run - 1);
+  memcpy(w->block + w->used, end, 8);
+  w->used += 8;
+  error = qoi_flush(w);
+  free(w->block);
+  w->block = NULL;
+  return error;
+}
+
+/*write_qoi writes the canvas as a QOI image, a row at a time*/
+
+int write_qoi (int fd, canvas_ptr cv)
+{
+  qoi_writer w;
+  int row, error;
+
+  error = qoi_start (&w, fd, cv);
+  for (row = cv->height - 1; (row >= 0) && (error == NO_ERROR); row--) error = qoi_row (&w, &PIXEL(cv, 0, row));
+  if (error == NO_ERROR) return qoi_finish (&w);
+  free(w.block);
+  return error;
+}
+
+/*write_parts writes count buffers with writev, repeating it only if the*/
+/*write comes back short. The iovecs are used up on the way.*/
+
+int write_parts (int fd, struct iovec *iov, int count)
+{
+  ssize_t done;
+  int first;
+
+  first = 0;
+  while (first < count)
+    {
+      done = writev(fd, iov + first, count - first);
+      if (done < 0)
+	{
+	  if (errno == EINTR) continue;
+	  return ERR_WRITE;
+	}
+      while ((first < count) && ((size_t) done >= iov[first].iov_len))
+	{
+	  done -= iov[first].iov_len;
+	  first++;
+	}
+      if (first < count)
+	{
+	  iov[first].iov_base = (char *) iov[first].iov_base + done;
+	  iov[first].iov_len -= done;
+	}
+    }
+  return NO_ERROR;
+}
+
+/*set_size changes the size of the canvas to the width and height given in*/
+/*the command*/
+
+int set_size (command_ptr cmd, scene_ptr sc)
+{
+  return scene_size(sc, cmd->word[1].value, cmd->word[2].value);
+}
+
+/*scene_size changes the size of the canvas of a scene, up to the largest*/
+/*size its options allow*/
+
+int scene_size (scene_ptr sc, int width, int height)
+{
+  if ((sc->options.max_width > 0) && ((width > sc->options.max_width) || (height > sc->options.max_height))) return ERR_SIZE;
+  return resize_canvas(&sc->cv, width, height);
+}
+
+/*compute_midpt computes the mid point of two points*/
+
+void compute_midpt (int *centerx, int *centery, int x1, int y1, int x2, int y2)
+{
+  double diffx, diffy, cenx, ceny;
+
+  if (x1 < x2) diffx = (double) ((x2 - x1)/2.0);
+  else diffx = (double) ((x1 - x2)/2.0);
+
+  if (y1 < y2) diffy = (double) ((y2 - y1)/2.0);
+  else diffy = (double) ((y1 - y2)/2.0);
+
+  if (x1 < x2) cenx = (((double)(x1)) + diffx);
+  else cenx = (((double)(x2)) + diffx);
+
+  if (y1 < y2) ceny = (((double)(y1)) + diffy);
+  else ceny = (((double)(y2)) + diffy);
+
+  *centerx = round_off(cenx);
+  *centery = round_off(ceny);
+}
+
+/*round_off rounds off a decimal to an integer. The original version printed*/
+/*the value with "%.1f" and rounded up on a tenths digit of 5 or more, away*/
+/*from zero for negative values. This does the same with arithmetic: 10 times*/
+/*the magnitude is formed exactly as 8x + 2x plus the rounding error of that*/
+/*sum, rounded to the nearest integer with ties to even like printf, and the*/
+/*tenths are then rounded half up. Build with -DPRINTF_ROUND to get the*/
+/*original string-based version, round_printf, back. Values beyond the*/
+/*range of an int, infinities included, give the largest int of their sign*/
+/*and NaN gives 0, where the original stopped the program.*/
+
+#ifndef PRINTF_ROUND
+
+int round_off (double entry)
+{
+  double mag, big, small, tenths, err, back, whole, frac;
+  long result;
+
+  if (entry != entry) return 0;
+  mag = fabs(entry);
+  if (mag >= 2147483647.0) return (entry < 0) ? -2147483647 : 2147483647;
+
+  big = 8.0 * mag;
+  small = 2.0 * mag;
+  tenths = big + small;
+  back = tenths - big;
+  err = (big - (tenths - back)) + (small - back);
+
+  whole = floor(tenths);
+  frac = (tenths - whole) - 0.5;
+  result = (long) whole;
+  if ((frac > 0) || ((frac == 0) && ((err > 0) || ((err == 0) && (result % 2 != 0))))) result++;
+
+  result = (result + 5) / 10;
+  return (int) ((entry < 0) ? -result : result);
+}
+
+#else
+
+int round_off (double entry)
+{
+  return round_printf(entry);
+}
+
+#endif
+
+/*round_printf is the original string-based round_off. It is always built so*/
+/*that --check-round can compare the two.*/
+
+int round_printf (double entry)
+{
+  char buf[128];
+  char* marker;
+  int flag, result;
+
+  if (entry != entry) return 0;
+  if (fabs(entry) >= 2147483647.0) return (entry < 0) ? -2147483647 : 2147483647;
+
+  sprintf(buf, "%.1f", entry);
+  /* locate the decimal point */
+  marker = strchr(buf, '.');
+  if (marker == NULL) return 0;
+  
+  if (entry >= 0)
+    {
+      if ((*(marker+1)-'0') > ('4' - '0'))
+	{
+	  flag = 1;  /*means we need to add 1*/
+	}
+      else
+	{
+	  flag=0;
+	}
+      *(marker + 1) = '\0';
+      sscanf(buf, "%d", &result);
+      if (flag)
+	{
+	  result += 1;
+	}
+    }
+
+  else 
+    {
+      if ((*(marker+1)-'0') > ('4' - '0'))
+	{
+	  flag = 1;  /*means we need to add -1*/
+	}
+      else
+	{
+	  flag=0;
+	}
+      *(marker + 1) = '\0';
+      sscanf(buf, "%d", &result);
+      if (flag)
+	{
+	  result += -1;
+	}
+    }
+
+  return result;
+}
+
+/*compute_slope computes the slope of a line*/
+
+double compute_slope (int x1, int y1, int x2, int y2)
+{
+  double res, xc, yc;
+
+  xc = (double) (x1 - x2);
+  yc = (double) (y1 - y2);
+  res = yc / xc;
+  return res;
+}
+
+/*create_point creates point by placing values to char array*/
+
+void create_point (canvas_ptr cv, pts_ptr ps)
+{
+  long long written = 0;
+  int index, x, y;
+
+  for (index = pool_next(ps, 0); index >= 0; index = pool_next(ps, index + 1))
+    {
+      x = ps->coord[PT_X][index] - 1;
+      y = ps->coord[PT_Y][index] - 1;
+      if (IN_CLIP(cv, x, y))
+	{
+	  PIXEL(cv, x, y) = ps->color[index];
+	  written++;
+	}
+    }
+  if (cv->drawn != NULL) cv->drawn[SHAPE_POINT] += written;
+}
+
+/*create_line creates line by placing values to char array*/
+
+void create_line (canvas_ptr cv, ln_ptr ls, int legacy)
+{
+  int index;
+
+  for (index = pool_next(ls, 0); index >= 0; index = pool_next(ls, index + 1))
+    {
+      if (legacy)
+	{
+	  draw_line_legacy (cv, ls->coord[LN_X1][index]-1, ls->coord[LN_Y1][index]-1,
+			    ls->coord[LN_X2][index]-1, ls->coord[LN_Y2][index]-1, ls->color[index]);
+	}
+      else
+	{
+	  draw_line (cv, ls->coord[LN_X1][index]-1, ls->coord[LN_Y1][index]-1,
+		     ls->coord[LN_X2][index]-1, ls->coord[LN_Y2][index]-1, ls->color[index]);
+	}
+    }
+}
+
+/*line_span narrows the steps [*first, *last] of a Bresenham walk to those*/
+/*whose offset on the minor axis, floor((2*i*minor + major) / (2*major)),*/
+/*lies within [lo, hi]. The offset never decreases, so the steps that are*/
+/*left form one range. Returns 0 when no step is left.*/
+
+static int line_span (long long major, long long minor, long long lo, long long hi, long long *first, long long *last)
+{
+  long long step;
+
+  if ((lo > hi) || (hi < 0) || (lo > minor)) return 0;
+  if ((minor > 0) && (lo > 0))
+    {
+      step = (2 * lo * major - major + 2 * minor - 1) / (2 * minor);
+      if (step > *first) *first = step;
+    }
+  if ((minor > 0) && (hi < minor))
+    {
+      step = (2 * (hi + 1) * major - major + 2 * minor - 1) / (2 * minor) - 1;
+      if (step < *last) *last = step;
+    }
+  return *first <= *last;
+}
+
+/*draw_line draws a line with Bresenham's algorithm using only integers. The*/
+/*walk always starts from the end with the smaller coordinate on the major*/
+/*axis, so a line gets the same pixels whichever way round its ends are given.*/
+/*The minor coordinate at step i is the start plus (2*i*minor + major) /*/
+/*(2*major), rounded down, which lets the walk start directly at the first*/
+/*step that lands in the clip rectangle.*/
+
+void draw_line (canvas_ptr cv, int xa, int ya, int xb, int yb, char color)
+{
+  long long major, minor, first, last, i, offset, err;
+  int x, y, step, temp;
+
+  if (ya == yb)
+    {
+      /*a horizontal line is a single span*/
+      if ((ya < cv->clip_y0) || (ya >= cv->clip_y1)) return;
+      if (xa > xb)
+	{
+	  temp = xa; xa = xb; xb = temp;
+	}
+      if (xa < cv->clip_x0) xa = cv->clip_x0;
+      if (xb > cv->clip_x1 - 1) xb = cv->clip_x1 - 1;
+      if (xa > xb) return;
+      cv->fill(&PIXEL(cv, xa, ya), color, xb - xa + 1);
+      if (cv->drawn != NULL) cv->drawn[SHAPE_LINE] += xb - xa + 1;
+      return;
+    }
+
+  if (compute_diff(xa, xb) >= compute_diff(ya, yb))
+    {
+      if (xa > xb)
+	{
+	  temp = xa; xa = xb; xb = temp;
+	  temp = ya; ya = yb; yb = temp;
+	}
+      major = xb - xa;
+      minor = compute_diff(ya, yb);
+      step = (yb < ya) ? -1 : 1;
+      first = (xa < cv->clip_x0) ? cv->clip_x0 - xa : 0;
+      last = (xb > cv->clip_x1 - 1) ? cv->clip_x1 - 1 - xa : major;
+      if (step > 0)
+	{
+	  if (!line_span(major, minor, cv->clip_y0 - ya, cv->clip_y1 - 1 - ya, &first, &last)) return;
+	}
+      else if (!line_span(major, minor, ya - (cv->clip_y1 - 1), ya - cv->clip_y0, &first, &last)) return;
+      if (cv->drawn != NULL) cv->drawn[SHAPE_LINE] += last - first + 1;
+
+      offset = (2 * first * minor + major) / (2 * major);
+      err = 2 * first * minor + major - 2 * major * offset;
+      y = ya + step * (int) offset;
+      for (i = first; i <= last; i++)
+	{
+	  PIXEL(cv, xa + i, y) = color;
+	  err += 2 * minor;
+	  if (err >= 2 * major)
+	    {
+	      y += step;
+	      err -= 2 * major;
+	    }
+	}
+    }
+  else {
+    if (ya > yb)
+      {
+	temp = xa; xa = xb; xb = temp;
+	temp = ya; ya = yb; yb = temp;
+      }
+    major = yb - ya;
+    minor = compute_diff(xa, xb);
+    step = (xb < xa) ? -1 : 1;
+    first = (ya < cv->clip_y0) ? cv->clip_y0 - ya : 0;
+    last = (yb > cv->clip_y1 - 1) ? cv->clip_y1 - 1 - ya : major;
+    if (step > 0)
+      {
+	if (!line_span(major, minor, cv->clip_x0 - xa, cv->clip_x1 - 1 - xa, &first, &last)) return;
+      }
+    else if (!line_span(major, minor, xa - (cv->clip_x1 - 1), xa - cv->clip_x0, &first, &last)) return;
+    if (cv->drawn != NULL) cv->drawn[SHAPE_LINE] += last - first + 1;
+
+    offset = (2 * first * minor + major) / (2 * major);
+    err = 2 * first * minor + major - 2 * major * offset;
+    x = xa + step * (int) offset;
+    for (i = first; i <= last; i++)
+      {
+	PIXEL(cv, x, ya + i) = color;
+	err += 2 * minor;
+	if (err >= 2 * major)
+	  {
+	    x += step;
+	    err -= 2 * major;
+	  }
+      }
+  }
+}
+
+/*legacy_round rounds num / den (den > 0) the way round_off rounds the double*/
+/*that the original line code computed for it: up when the fraction is above*/
+/*0.45, since "%.1f" turns x.45.. into x.5. Returns 0 when the fraction is*/
+/*exactly 0.45, where the outcome depends on the double's rounding error.*/
+
+static int legacy_round (long num, long den, int base, int *result)
+{
+  long q, r;
+
+  q = num / den;
+  r = num % den;
+  if (r < 0)
+    {
+      q--;
+      r += den;
+    }
+  if (20 * r == 9 * den) return 0;
+  *result = base + (int) q + ((20 * r > 9 * den) ? 1 : 0);
+  return 1;
+}
+
+/*draw_line_legacy reproduces the pixels of the original floating-point line*/
+/*code exactly. The positions are worked out with integers; only the rare*/
+/*samples whose fraction is exactly 0.45 go through the original double math.*/
+
+void draw_line_legacy (canvas_ptr cv, int xa, int ya, int xb, int yb, char color)
+{
+  long long written = 0;
+  int x1, x2, y1, y2, x, y, dx, dy, n, count;
+  double slope, part, xd, yd;
+
+  /*Vertical and horizontal lines are the same in both rasterizers*/
+  if ((xa == xb) || (ya == yb))
+    {
+      draw_line (cv, xa, ya, xb, yb, color);
+      return;
+    }
+
+  if (xa > xb)
+    {
+      x1 = xb; x2 = xa; y1 = yb; y2 = ya;
+    }
+  else {
+    x1 = xa; x2 = xb; y1 = ya; y2 = yb;
+  }
+  dx = x2 - x1;
+  dy = y2 - y1;
+  slope = compute_slope(xa, ya, xb, yb);
+
+  if (compute_diff(y1, y2) > dx)
+    {
+      /*Line with steep slope: diffy + 1 samples spread evenly along x*/
+      n = compute_diff(y1, y2) + 1;
+      part = ((double) dx) / ((double) n);
+      for (count = 0; count <= n; count++)
+	{
+	  if (!legacy_round((long) dx * count, n, x1, &x) || !legacy_round((long) dy * count, n, y1, &y))
+	    {
+	      xd = (((double) count) * part) + x1;
+	      yd = (slope * (xd - x1)) + y1;
+	      x = round_off(xd);
+	      y = round_off(yd);
+	    }
+	  if (IN_CLIP(cv, x, y))
+	    {
+	      PIXEL(cv, x, y) = color;
+	      written++;
+	    }
+	}
+    }
+  else {
+    /*Line with flat or regular slope: one sample per column*/
+    for (count = 0; count <= dx; count++)
+      {
+	if (!legacy_round((long) dy * count, dx, y1, &y))
+	  {
+	    yd = (slope * ((double) count)) + y1;
+	    y = round_off(yd);
+	  }
+	if (IN_CLIP(cv, x1 + count, y))
+	  {
+	    PIXEL(cv, x1 + count, y) = color;
+	    written++;
+	  }
+      }
+  }
+  if (cv->drawn != NULL) cv->drawn[SHAPE_LINE] += written;
+}
+
+/*create_box creates box by placing values to char array*/
+
+void create_box (canvas_ptr cv, bx_ptr bs)
+{
+  int index;
+
+  for (index = pool_next(bs, 0); index >= 0; index = pool_next(bs, index + 1))
+    {
+      draw_box (cv, bs->coord[BX_LEFT][index] - 1, bs->coord[BX_TOP][index] - 1,
+		bs->coord[BX_RIGHT][index] - 1, bs->coord[BX_BOTTOM][index] - 1, bs->color[index]);
+    }
+}
+
+/*draw_box fills the columns left to right of the rows bottom to top, one*/
+/*row span at a time*/
+
+void draw_box (canvas_ptr cv, int left, int top, int right, int bottom, char color)
+{
+  int count;
+
+  if (left < cv->clip_x0) left = cv->clip_x0;
+  if (bottom < cv->clip_y0) bottom = cv->clip_y0;
+  if (right > cv->clip_x1 - 1) right = cv->clip_x1 - 1;
+  if (top > cv->clip_y1 - 1) top = cv->clip_y1 - 1;
+  if (left > right) return;
+  for (count = bottom; count <= top; count++) cv->fill(&PIXEL(cv, left, count), color, right - left + 1);
+  if ((cv->drawn != NULL) && (bottom <= top)) cv->drawn[SHAPE_BOX] += (long long) (top - bottom + 1) * (right - left + 1);
+}
+
+/*fill_scalar sets count pixels to color eight at a time with plain stores*/
+
+void fill_scalar (char *pixels, int color, size_t count)
+{
+  unsigned long long word = 0x0101010101010101ULL * (unsigned char) color;
+
+  while ((count > 0) && ((size_t) pixels & 7))
+    {
+      *pixels++ = color;
+      count--;
+    }
+  for (; count >= 8; count -= 8, pixels += 8) memcpy(pixels, &word, 8);
+  while (count-- > 0) *pixels++ = color;
+}
+
+#ifdef SPAN_SIMD
+
+/*fill_sse2 sets count pixels to color with aligned 16-byte stores*/
+
+__attribute__((target("sse2"))) void fill_sse2 (char *pixels, int color, size_t count)
+{
+  __m128i value = _mm_set1_epi8((char) color);
+
+  if (count < 16)
+    {
+      while (count-- > 0) *pixels++ = color;
+      return;
+    }
+  /*one unaligned store covers the head, then aligned stores take over*/
+  _mm_storeu_si128((__m128i *) pixels, value);
+  count -= 16 - ((size_t) pixels & 15);
+  pixels += 16 - ((size_t) pixels & 15);
+  for (; count >= 64; count -= 64, pixels += 64)
+    {
+      _mm_store_si128((__m128i *) pixels, value);
+      _mm_store_si128((__m128i *) (pixels + 16), value);
+      _mm_store_si128((__m128i *) (pixels + 32), value);
+      _mm_store_si128((__m128i *) (pixels + 48), value);
+    }
+  for (; count >= 16; count -= 16, pixels += 16) _mm_store_si128((__m128i *) pixels, value);
+  if (count > 0) _mm_storeu_si128((__m128i *) (pixels + count - 16), value);
+}
+
+/*fill_avx2 sets count pixels to color with aligned 32-byte stores*/
+
+__attribute__((target("avx2"))) void fill_avx2 (char *pixels, int color, size_t count)
+{
+  __m256i value = _mm256_set1_epi8((char) color);
+
+  if (count < 32)
+    {
+      fill_sse2 (pixels, color, count);
+      return;
+    }
+  _mm256_storeu_si256((__m256i *) pixels, value);
+  count -= 32 - ((size_t) pixels & 31);
+  pixels += 32 - ((size_t) pixels & 31);
+  for (; count >= 128; count -= 128, pixels += 128)
+    {
+      _mm256_store_si256((__m256i *) pixels, value);
+      _mm256_store_si256((__m256i *) (pixels + 32), value);
+      _mm256_store_si256((__m256i *) (pixels + 64), value);
+      _mm256_store_si256((__m256i *) (pixels + 96), value);
+    }
+  for (; count >= 32; count -= 32, pixels += 32) _mm256_store_si256((__m256i *) pixels, value);
+  if (count > 0) _mm256_storeu_si256((__m256i *) (pixels + count - 32), value);
+}
+
+#else
+
+void fill_sse2 (char *pixels, int color, size_t count)
+{
+  fill_scalar (pixels, color, count);
+}
+
+void fill_avx2 (char *pixels, int color, size_t count)
+{
+  fill_scalar (pixels, color, count);
+}
+
+#endif
+
+/*choose_span_fill picks the widest span fill the processor can run*/
+
+span_filler choose_span_fill (void)
+{
+#ifdef SPAN_SIMD
+  if (__builtin_cpu_supports("avx2")) return fill_avx2;
+  if (__builtin_cpu_supports("sse2")) return fill_sse2;
+#endif
+  return fill_scalar;
+}
+
+#ifdef IDRAW_BENCH
+
+/*bench_fill measures the fill rate of every span fill, and of memset, on*/
+/*boxes of several sizes, after checking that they all fill the same pixels*/
+
+int bench_fill (void)
+{
+  static const int sizes[] = { 4, 16, 64, 256, 1024, 4096 };
+  static const char *names[] = { "scalar", "sse2", "avx2", "memset" };
+  span_filler fills[4];
+  struct timespec start, end;
+  char *pixels, *check;
+  double seconds, pixels_done;
+  int size, kind, row, rounds, count, usable;
+  size_t stride;
+
+  fills[0] = fill_scalar;
+  fills[1] = fill_sse2;
+  fills[2] = fill_avx2;
+  fills[3] = NULL;
+  stride = 4096 + 64;
+  pixels = malloc(stride * 4096 + 64);
+  check = malloc(stride * 4);
+  if ((pixels == NULL) || (check == NULL))
+    {
+      free(pixels);
+      free(check);
+      return ERR_MEMORY;
+    }
+
+  /*every fill must match the scalar one at every alignment and length*/
+  for (kind = 1; kind < 3; kind++)
+    for (count = 0; count < 300; count++)
+      for (row = 0; row < 64; row++)
+	{
+	  memset(check, 0, 2 * stride);
+	  fill_scalar (check + row, 3, count);
+	  memset(pixels, 0, 2 * stride);
+	  fills[kind] (pixels + row, 3, count);
+	  if (memcmp(check, pixels, 2 * stride) != 0)
+	    {
+	      printf ("ERROR: %s fill differs at offset %d, length %d!\n", names[kind], row, count);
+	      free(pixels);
+	      free(check);
+	      return ERR_WRITE;
+	    }
+	}
+
+  for (kind = 0; (kind < 2) && (fills[kind] != choose_span_fill()); kind++);
+  printf ("{\"bench\": \"fill\", \"selected\": \"%s\", \"results\": [\n", names[kind]);
+  for (size = 0; size < (int) (sizeof(sizes) / sizeof(sizes[0])); size++)
+    {
+      for (kind = 0; kind < 4; kind++)
+	{
+#ifdef SPAN_SIMD
+	  usable = (kind != 2) || __builtin_cpu_supports("avx2");
+#else
+	  usable = 1;
+#endif
+	  if (!usable) continue;
+	  rounds = 0;
+	  clock_gettime(CLOCK_MONOTONIC, &start);
+	  do
+	    {
+	      /*boxes of size x size pixels, one row span at a time, between*/
+	      /*clock reads*/
+	      for (count = 0; count * sizes[size] * sizes[size] < (1 << 20); count++, rounds++)
+		for (row = 0; row < sizes[size]; row++)
+		  {
+		    if (fills[kind] != NULL) fills[kind] (pixels + 1 + row * stride, rounds & 3, sizes[size]);
+		    else memset(pixels + 1 + row * stride, rounds & 3, sizes[size]);
+		  }
+	      clock_gettime(CLOCK_MONOTONIC, &end);
+	      seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	    }
+	  while (seconds < 0.2);
+	  pixels_done = (double) rounds * sizes[size] * sizes[size];
+	  printf ("  {\"box\": %d, \"fill\": \"%s\", \"gpixels_per_s\": %.3f}%s\n", sizes[size], names[kind],
+		  pixels_done / seconds * 1e-9, ((size + 1 == (int) (sizeof(sizes) / sizeof(sizes[0]))) && (kind == 3)) ? "" : ",");
+	}
+    }
+  printf ("]}\n");
+  free(pixels);
+  free(check);
+  return NO_ERROR;
+}
+
+#endif
+
+/*round_matches compares round_off with round_printf on value, printing the*/
+/*first few values where they differ*/
+
+static void round_matches (double value, long *checked, long *wrong)
+{
+  int fast, reference;
+
+  fast = round_off(value);
+  reference = round_printf(value);
+  (*checked)++;
+  if (fast == reference) return;
+  if (*wrong < 10) printf ("ERROR: round_off(%.17g) gives %d instead of %d!\n", value, fast, reference);
+  (*wrong)++;
+}
+
+/*check_round checks that round_off rounds every value the drawing code can*/
+/*give it the way round_printf does: the samples of every circle up to the*/
+/*largest radius of the largest canvas, the samples of the original line*/
+/*code, every midpoint, and every value of the form x.x5 on the canvas. It*/
+/*returns 1 when any of them differ and 0 when none do.*/
+
+int check_round (void)
+{
+  canvas widest;
+  long checked = 0, wrong = 0;
+  double angle, par, slope, part, xd;
+  int count, count2, dx, dy, start, n, limit;
+
+  widest.width = CANVAS_MAX;
+  widest.height = CANVAS_MAX;
+  limit = radius_max(&widest);
+
+  /*the samples of draw_circle_legacy*/
+  for (count = 0; count < 360; count++)
+    {
+      angle = acos(-1);
+      par = (double) (count);
+      par = par / 180.0;
+      angle = angle * par;
+      for (count2 = 0; count2 <= limit; count2++)
+	{
+	  round_matches (count2 * (cos(angle)), &checked, &wrong);
+	  round_matches (count2 * (sin(angle)), &checked, &wrong);
+	}
+    }
+
+  /*the samples of draw_line_legacy, from near both ends of the canvas*/
+  for (start = 1; start < CANVAS_MAX; start += CANVAS_MAX - 202)
+    for (dx = 1; dx <= 100; dx++)
+      for (dy = -100; dy <= 100; dy++)
+	{
+	  if (dy == 0) continue;
+	  slope = compute_slope(start, start, start + dx, start + dy);
+	  if (compute_diff(start, start + dy) > dx)
+	    {
+	      n = compute_diff(start, start + dy) + 1;
+	      part = ((double) dx) / ((double) n);
+	      for (count = 0; count <= n; count++)
+		{
+		  xd = (((double) count) * part) + start;
+		  round_matches (xd, &checked, &wrong);
+		  round_matches ((slope * (xd - start)) + start, &checked, &wrong);
+		}
+	    }
+	  else
+	    for (count = 0; count <= dx; count++) round_matches ((slope * ((double) count)) + start, &checked, &wrong);
+	}
+
+  /*compute_midpt gives whole and half coordinates, and x.x5 are the ties*/
+  /*of "%.1f"*/
+  for (count = 0; count <= 2 * CANVAS_MAX; count++) round_matches (count / 2.0, &checked, &wrong);
+  for (count = -CANVAS_MAX * 10; count <= CANVAS_MAX * 10; count++) round_matches (count / 10.0 + 0.05, &checked, &wrong);
+
+  /*and values that aren't coordinates at all saturate the same way*/
+  round_matches (1e300, &checked, &wrong);
+  round_matches (-1e300, &checked, &wrong);
+  round_matches (HUGE_VAL, &checked, &wrong);
+  round_matches (-HUGE_VAL, &checked, &wrong);
+  round_matches (NAN, &checked, &wrong);
+
+  printf ("{\"check\": \"round\", \"values\": %ld, \"mismatches\": %ld}\n", checked, wrong);
+  return (wrong > 0);
+}
+
+/*create_circle creates circle by placing values to char array*/
+
+void create_circle (canvas_ptr cv, cir_ptr cs, int legacy)
+{
+  int index;
+
+  for (index = pool_next(cs, 0); index >= 0; index = pool_next(cs, index + 1))
+    {
+      if (legacy)
+	{
+	  draw_circle_legacy (cv, cs->coord[CR_X][index] - 1, cs->coord[CR_Y][index] - 1,
+			      cs->coord[CR_RADIUS][index], cs->color[index]);
+	}
+      else
+	{
+	  draw_disc (cv, cs->coord[CR_X][index] - 1, cs->coord[CR_Y][index] - 1,
+		     cs->coord[CR_RADIUS][index], cs->color[index]);
+	}
+    }
+}
+
+/*draw_disc fills a circle one row at a time. A pixel is covered when its*/
+/*distance from the center is within rad + 1/2, that is when*/
+/*dx*dx + dy*dy <= rad*rad + rad. The half width of each row only shrinks as*/
+/*the row moves away from the center, so it is found by stepping it down*/
+/*instead of with square roots. Every run is clipped to the clip rectangle*/
+/*and every covered pixel is written once.*/
+
+void draw_disc (canvas_ptr cv, int cenx, int ceny, int rad, char color)
+{
+  long long limit, written = 0;
+  int half, dy, row, left, right;
+
+  limit = (long long) rad * rad + rad;
+  half = rad;
+  for (dy = 0; dy <= rad; dy++)
+    {
+      while ((long long) half * half + (long long) dy * dy > limit) half--;
+
+      left = cenx - half;
+      right = cenx + half;
+      if (left < cv->clip_x0) left = cv->clip_x0;
+      if (right > cv->clip_x1 - 1) right = cv->clip_x1 - 1;
+      if (left > right) continue;
+
+      row = ceny + dy;
+      if ((row >= cv->clip_y0) && (row < cv->clip_y1))
+	{
+	  cv->fill(&PIXEL(cv, left, row), color, right - left + 1);
+	  written += right - left + 1;
+	}
+      row = ceny - dy;
+      if ((dy != 0) && (row >= cv->clip_y0) && (row < cv->clip_y1))
+	{
+	  cv->fill(&PIXEL(cv, left, row), color, right - left + 1);
+	  written += right - left + 1;
+	}
+    }
+  if (cv->drawn != NULL) cv->drawn[SHAPE_CIRCLE] += written;
+}
+
+/*draw_circle_legacy reproduces the pixels of the original circle code, which*/
+/*samples every degree of every radius step and thickens the inner samples*/
+/*by one pixel. Samples next to the canvas edge are not thickened. Only the*/
+/*pixels inside the clip rectangle are written.*/
+
+void draw_circle_legacy (canvas_ptr cv, int cenx, int ceny, int rad, char color)
+{
+  long long written = 0;
+  int count, count2, x, y, ptx, pty;
+  double angle, par;
+
+  for (count = 0; count < 360; count++)
+    {
+      angle = acos(-1);
+      par = (double) (count);
+      par = par / 180.0;
+      angle = angle * par;
+      for (count2 = 0; count2 <= rad; count2++)
+	{
+	  x =  round_off(count2 * (cos(angle)));
+	  y =  round_off(count2 * (sin(angle)));
+	  ptx = cenx + x;
+	  pty = ceny + y;
+	  if ((ptx >= 0) && (pty >= 0) && (ptx < cv->width) && (pty < cv->height))
+	    {
+	      if ((count2 != rad) && (ptx != 0) && (ptx != cv->width - 1) && (pty != 0) && (pty != cv->height - 1))
+		{ 
+		  if (IN_CLIP(cv, ptx + 1, pty))
+		    {
+		      PIXEL(cv, ptx + 1, pty) = color;
+		      written++;
+		    }
+		  if (IN_CLIP(cv, ptx - 1, pty))
+		    {
+		      PIXEL(cv, ptx - 1, pty) = color;
+		      written++;
+		    }
+		  if (IN_CLIP(cv, ptx, pty + 1))
+		    {
+		      PIXEL(cv, ptx, pty + 1) = color;
+		      written++;
+		    }
+		  if (IN_CLIP(cv, ptx, pty - 1))
+		    {
+		      PIXEL(cv, ptx, pty - 1) = color;
+		      written++;
+		    }
+		}
+	      if (IN_CLIP(cv, ptx, pty))
+		{
+		  PIXEL(cv, ptx, pty) = color;
+		  written++;
+		}
+	    }
+	}
+    }
+  if (cv->drawn != NULL) cv->drawn[SHAPE_CIRCLE] += written;
+}
+
+#ifdef SPAN_SIMD
+
+/*rows_sse2 places samples on rows four at a time the way graph_rows does*/
+/*and returns how many it placed*/
+
+__attribute__((target("sse2"))) static int rows_sse2 (const float *values, int count, float scale, float offset, int height, int *rows)
+{
+  __m128 mul = _mm_set1_ps(scale), add = _mm_set1_ps(offset), one = _mm_set1_ps(1.0f);
+  __m128 half = _mm_set1_ps(height / 2.0f), top = _mm_set1_ps((float) height), zero = _mm_setzero_ps();
+  __m128 tenths = _mm_set1_ps(0.45f), mark, whole;
+  int n;
+
+  for (n = 0; n + 4 <= count; n += 4)
+    {
+      mark = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + n), mul), add), one), half);
+      /*max gives zero for a NaN*/
+      mark = _mm_min_ps(_mm_max_ps(mark, zero), top);
+      whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(mark));
+      whole = _mm_add_ps(whole, _mm_and_ps(_mm_cmpgt_ps(_mm_sub_ps(mark, whole), tenths), one));
+      _mm_storeu_si128((__m128i *) (rows + n), _mm_cvttps_epi32(_mm_max_ps(whole, one)));
+    }
+  return n;
+}
+
+#endif
+
+/*graph_rows places count samples on the rows of a canvas height pixels*/
+/*high, a sample of -1 to 1 spanning the height once scaled and offset. The*/
+/*rows are rounded as round_off rounds and kept within 1 to height. Marks*/
+/*are clamped to 0 to height first, where round_off comes down to adding 1*/
+/*to the whole part when the fraction, which is exact, is above 0.45f: no*/
+/*float lies between 0.45f and 0.45.*/
+
+void graph_rows (const float *values, int count, float scale, float offset, int height, int *rows)
+{
+  float mark, whole;
+  int n = 0;
+
+#ifdef SPAN_SIMD
+  if (__builtin_cpu_supports("sse2")) n = rows_sse2(values, count, scale, offset, height, rows);
+#endif
+  for (; n < count; n++)
+    {
+      mark = (values[n] * scale + offset + 1) * (height / 2.0f);
+      if (!(mark > 0)) mark = 0;
+      if (mark > height) mark = height;
+      whole = (float) (int) mark;
+      rows[n] = (int) whole + (mark - whole > 0.45f);
+      if (rows[n] < 1) rows[n] = 1;
+    }
+}
+
+/*create_graph creates graph by placing values to char array. The grid lines*/
+/*cross in the middle of the canvas and each series is drawn over them in*/
+/*order of id. The rows of a series are found GRAPH_CHUNK columns at a time*/
+/*by graph_rows, so drawing it is one pass over its columns.*/
+
+void create_graph (canvas_ptr cv, graph_set_ptr gs)
+{
+  int bottoms[GRAPH_CHUNK], tops[GRAPH_CHUNK];
+  long long written = 0;
+  int count, series, columns, chunk, column, y, top, bottom, midx, midy;
+  graph_ptr g;
+
+  if (gs->count > 0)
+    {
+      /*create the grid lines*/
+      midx = cv->width / 2 - 1;
+      midy = cv->height / 2 - 1;
+      if (midx < 0) midx = 0;
+      if (midy < 0) midy = 0;
+      if ((midy >= cv->clip_y0) && (midy < cv->clip_y1))
+	{
+	  for (count = cv->clip_x0; count < cv->clip_x1; count++) PIXEL(cv, count, midy) = 1;
+	  written += cv->clip_x1 - cv->clip_x0;
+	}
+      if ((midx >= cv->clip_x0) && (midx < cv->clip_x1))
+	{
+	  for (count = cv->clip_y0; count < cv->clip_y1; count++) PIXEL(cv, midx, count) = 1;
+	  written += cv->clip_y1 - cv->clip_y0;
+	}
+
+      /*each column runs from the row of its lowest sample to the row of*/
+      /*its highest, which swap over when the scale is negative*/
+      for (series = 0; series < gs->count; series++)
+	{
+	  g = &gs->series[series];
+	  columns = (g->count < cv->clip_x1) ? g->count : cv->clip_x1;
+	  for (count = cv->clip_x0; count < columns; count += chunk)
+	    {
+	      chunk = (columns - count < GRAPH_CHUNK) ? columns - count : GRAPH_CHUNK;
+	      graph_rows (((g->scale < 0) ? g->high : g->low) + count, chunk, g->scale, g->offset, cv->height, bottoms);
+	      graph_rows (((g->scale < 0) ? g->low : g->high) + count, chunk, g->scale, g->offset, cv->height, tops);
+	      for (column = 0; column < chunk; column++)
+		{
+		  bottom = bottoms[column];
+		  top = tops[column];
+		  if (bottom - 1 < cv->clip_y0) bottom = cv->clip_y0 + 1;
+		  if (top - 1 > cv->clip_y1 - 1) top = cv->clip_y1;
+		  for (y = bottom - 1; y < top; y++) PIXEL(cv, count + column, y) = g->color;
+		  if (top >= bottom) written += top - bottom + 1;
+		}
+	    }
+	}
+      if (cv->drawn != NULL) cv->drawn[SHAPE_GRAPH] += written;
+    }
+}
+
+/*compute_diff computes the difference (absolute value) of 2 numbers*/
+
+int compute_diff (int a, int b)
+{
+  if (a > b) return (a-b);
+  else return (b-a);
+}
+
+/*put_le16 and put_le32 store a value in little-endian byte order*/
+
+static void put_le16 (unsigned char *at, unsigned long value)
+{
+  at[0] = value & 0xFF;
+  at[1] = (value >> 8) & 0xFF;
+}
+
+static void put_le32 (unsigned char *at, unsigned long value)
+{
+  at[0] = value & 0xFF;
+  at[1] = (value >> 8) & 0xFF;
+  at[2] = (value >> 16) & 0xFF;
+  at[3] = (value >> 24) & 0xFF;
+}
+
+/*BMPheader builds the file header, info header and palette of the bitmap*/
+/*into the canvas. They only depend on the canvas size.*/
+
+void BMPheader (canvas_ptr cv)
+{
+  unsigned char *h = cv->header;
+  unsigned long size = (unsigned long) cv->stride * cv->height;
+
+  memset (h, 0, BMP_HEADER);
+
+  h[0] = 'B';                   /* BITMAP ID */
+  h[1] = 'M';
+  put_le32 (h + 2, BMP_HEADER + size); /* File Size */
+  put_le32 (h + 6, 0);          /* Reserved */
+  put_le32 (h + 10, BMP_HEADER); /* Bitmap Data Offset */
+  put_le32 (h + 14, 0x28);      /* Bitmap Header Size */
+  put_le32 (h + 18, cv->width); /* Horizontal Width */
+  put_le32 (h + 22, cv->height); /* Veritcal Height */
+  put_le16 (h + 26, 1);         /* Number of Planes */
+  put_le16 (h + 28, 8);         /* Bits Per Pixel */
+  put_le32 (h + 30, 0);         /* Compression */
+  put_le32 (h + 34, size);      /* Bitmap Data Size */
+  put_le32 (h + 38, 0);         /* Horizontal Resolution */
+  put_le32 (h + 42, 0);         /* Vertical Resolution */
+  put_le32 (h + 46, 256);       /* Number of Colors */
+  put_le32 (h + 50, 0);         /* Number of Important Colors */
+
+  /* Palette, the 251 unused entries stay black */
+
+  put_le32 (h + 54, 0x00FFFFFF); /* WHITE */
+  put_le32 (h + 58, 0x00000000); /* BLACK */
+  put_le32 (h + 62, 0x00FF0000); /* RED */
+  put_le32 (h + 66, 0x0000FF00); /* GREEN */
+  put_le32 (h + 70, 0x000000FF); /* BLUE */
+}
+
+/*get_le32 reads a little-endian int*/
+
+static unsigned long get_le32 (const unsigned char *at)
+{
+  return at[0] | ((unsigned long) at[1] << 8) | ((unsigned long) at[2] << 16) | ((unsigned long) at[3] << 24);
+}
+
+/*anim_open creates the animation file of the script filename and writes*/
+/*its header*/
+
+int anim_open (animation_ptr a, const char *filename)
+{
+  unsigned char header[8];
+  char *name;
+
+  memset(a, 0, sizeof(animation));
+  name = malloc(strlen(filename) + sizeof(ANIM_SUFFIX));
+  if (name == NULL) return ERR_MEMORY;
+  strcpy(name, filename);
+  strcat(name, ANIM_SUFFIX);
+  a->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  free(name);
+  if (a->fd < 0) return ERR_CREATEFILE;
+
+  put_le32 (header, ANIM_MAGIC);
+  put_le32 (header + 4, ANIM_VERSION);
+  if (write(a->fd, header, 8) != 8)
+    {
+      close(a->fd);
+      return ERR_WRITE;
+    }
+  return NO_ERROR;
+}
+
+/*put_count writes a count 7 bits to a byte and returns the bytes used*/
+
+static int put_count (unsigned char *at, size_t count)
+{
+  int used = 0;
+
+  while (count >= 0x80)
+    {
+      at[used++] = (count & 0x7F) | 0x80;
+      count >>= 7;
+    }
+  at[used++] = count;
+  return used;
+}
+
+/*get_count reads a count written by put_count, moving *at past it. Returns*/
+/*0 if it runs past end.*/
+
+static int get_count (const unsigned char **at, const unsigned char *end, size_t *count)
+{
+  int shift = 0;
+
+  *count = 0;
+  while ((*at < end) && (shift < 63))
+    {
+      *count |= (size_t) (**at & 0x7F) << shift;
+      if (!(*(*at)++ & 0x80)) return 1;
+      shift += 7;
+    }
+  return 0;
+}
+
+/*same_run returns how many bytes from pos on are the same in a and b,*/
+/*comparing 8 bytes at a time*/
+
+static size_t same_run (const char *a, const char *b, size_t pos, size_t size)
+{
+  unsigned long long wa, wb;
+  size_t start = pos;
+
+  while ((pos + 8 <= size))
+    {
+      memcpy(&wa, a + pos, 8);
+      memcpy(&wb, b + pos, 8);
+      if (wa != wb) break;
+      pos += 8;
+    }
+  while ((pos < size) && (a[pos] == b[pos])) pos++;
+  return pos - start;
+}
+
+/*delta_encode writes the runs of changes from previous to pixels into the*/
+/*delta buffer, bringing previous up to date on the way, and sets *length to*/
+/*their length. Returns 0, with previous left part way, when the runs would*/
+/*take more room than the pixels themselves.*/
+
+static int delta_encode (animation_ptr a, const char *pixels, size_t size, size_t *length)
+{
+  size_t pos = 0, out = 0, skip, start, same, byte;
+
+  while (pos < size)
+    {
+      skip = same_run(pixels, a->previous, pos, size);
+      pos += skip;
+      if (pos == size) break;
+
+      /*a run of changes ends at 4 unchanged bytes, fewer cost less kept in*/
+      start = pos;
+      while (pos < size)
+	{
+	  if (pixels[pos] != a->previous[pos])
+	    {
+	      pos++;
+	      continue;
+	    }
+	  same = same_run(pixels, a->previous, pos, (pos + 4 < size) ? pos + 4 : size);
+	  if ((same == 4) || (pos + same == size)) break;
+	  pos += same;
+	}
+
+      if (out + 20 + (pos - start) > size) return 0;
+      out += put_count(a->delta + out, skip);
+      out += put_count(a->delta + out, pos - start);
+      for (byte = start; byte < pos; byte++)
+	{
+	  a->delta[out++] = pixels[byte] ^ a->previous[byte];
+	  a->previous[byte] = pixels[byte];
+	}
+    }
+  *length = out;
+  return 1;
+}
+
+/*anim_frame adds the canvas to the animation as a frame named name. It is*/
+/*a delta frame when the size is the same as the frame before and the*/
+/*changes take less room than the pixels, and a key frame otherwise.*/
+
+int anim_frame (animation_ptr a, const char *name, canvas_ptr cv)
+{
+  unsigned char header[ANIM_FRAME];
+  struct iovec iov[3];
+  size_t size = (size_t) cv->stride * cv->height, length = 0;
+  char *previous;
+  int kind = FRAME_KEY;
+
+  if ((a->frames > 0) && (a->width == cv->width) && (a->height == cv->height))
+    {
+      if (a->delta_capacity < size + 20)
+	{
+	  free(a->delta);
+	  a->delta = malloc(size + 20);
+	  a->delta_capacity = (a->delta != NULL) ? size + 20 : 0;
+	}
+      if ((a->delta != NULL) && delta_encode(a, cv->pixels, size, &length)) kind = FRAME_DELTA;
+    }
+  if (kind == FRAME_KEY)
+    {
+      if ((a->previous == NULL) || (a->width != cv->width) || (a->height != cv->height))
+	{
+	  previous = realloc(a->previous, size);
+	  if (previous == NULL) return ERR_MEMORY;
+	  a->previous = previous;
+	}
+      memcpy(a->previous, cv->pixels, size);
+      a->width = cv->width;
+      a->height = cv->height;
+      length = size;
+    }
+
+  put_le32 (header, kind);
+  put_le32 (header + 4, cv->width);
+  put_le32 (header + 8, cv->height);
+  put_le32 (header + 12, strlen(name));
+  put_le32 (header + 16, length);
+  iov[0].iov_base = header;
+  iov[0].iov_len = ANIM_FRAME;
+  iov[1].iov_base = (char *) name;
+  iov[1].iov_len = strlen(name);
+  iov[2].iov_base = (kind == FRAME_KEY) ? (void *) cv->pixels : (void *) a->delta;
+  iov[2].iov_len = length;
+  a->frames++;
+  return write_parts (a->fd, iov, 3);
+}
+
+/*anim_close finishes the animation file and frees what it held*/
+
+int anim_close (animation_ptr a)
+{
+  int error = NO_ERROR;
+
+  if (close(a->fd) != 0) error = ERR_WRITE;
+  free(a->previous);
+  free(a->delta);
+  memset(a, 0, sizeof(animation));
+  a->fd = -1;
+  return error;
+}
+
+/*delta_apply XORs the runs of a delta frame into pixels. Returns 0 if the*/
+/*runs are cut short or go past the pixels.*/
+
+static int delta_apply (char *pixels, size_t size, const unsigned char *at, const unsigned char *end)
+{
+  size_t pos = 0, skip, count;
+
+  while (at < end)
+    {
+      if (!get_count(&at, end, &skip) || !get_count(&at, end, &count)) return 0;
+      if ((skip > size - pos) || (count > size - pos - skip) || (count > (size_t) (end - at))) return 0;
+      pos += skip;
+      while (count-- > 0) pixels[pos++] ^= *at++;
+    }
+  return 1;
+}
+
+/*anim_extract writes every frame of the animation file filename as a*/
+/*bitmap file frame00000.bmp, frame00001.bmp and so on in directory, and*/
+/*lists each with the name it was saved under*/
+
+int anim_extract (const char *filename, const char *directory)
+{
+  canvas cv;
+  struct stat st;
+  const unsigned char *data, *at, *end;
+  char *path;
+  size_t size, name_length, length;
+  int fd, out, kind, width, height, frame, error = NO_ERROR;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) return ERR_OPENFILE;
+  if ((fstat(fd, &st) != 0) || (st.st_size < 8))
+    {
+      close(fd);
+      return ERR_READ;
+    }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return ERR_READ;
+  end = data + st.st_size;
+  if ((get_le32(data) != ANIM_MAGIC) || (get_le32(data + 4) != ANIM_VERSION))
+    {
+      munmap((void *) data, st.st_size);
+      return ERR_READ;
+    }
+
+  initialize_canvas (&cv);
+  path = malloc(strlen(directory) + 32);
+  if (path == NULL) error = ERR_MEMORY;
+  at = data + 8;
+  for (frame = 0; (error == NO_ERROR) && (at < end); frame++)
+    {
+      if (end - at < ANIM_FRAME)
+	{
+	  error = ERR_READ;
+	  break;
+	}
+      kind = get_le32(at);
+      width = get_le32(at + 4);
+      height = get_le32(at + 8);
+      name_length = get_le32(at + 12);
+      length = get_le32(at + 16);
+      at += ANIM_FRAME;
+      if ((name_length > (size_t) (end - at)) || (length > (size_t) (end - at) - name_length))
+	{
+	  error = ERR_READ;
+	  break;
+	}
+
+      /*the first frame and every change of size must be a key frame*/
+      if ((kind == FRAME_KEY) || (cv.pixels == NULL) || (cv.width != width) || (cv.height != height))
+	{
+	  if ((kind != FRAME_KEY) || (resize_canvas(&cv, width, height) != NO_ERROR))
+	    {
+	      error = ERR_READ;
+	      break;
+	    }
+	}
+      size = (size_t) cv.stride * cv.height;
+      if (cv.pixels == NULL) cv.pixels = malloc(size);
+      if (cv.pixels == NULL)
+	{
+	  error = ERR_MEMORY;
+	  break;
+	}
+      if (kind == FRAME_KEY)
+	{
+	  if (length != size) error = ERR_READ;
+	  else memcpy(cv.pixels, at + name_length, size);
+	}
+      else if ((kind != FRAME_DELTA) || !delta_apply(cv.pixels, size, at + name_length, at + name_length + length)) error = ERR_READ;
+      if (error != NO_ERROR) break;
+
+      sprintf(path, "%s/frame%05d.bmp", directory, frame);
+      out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if (out < 0)
+	{
+	  error = ERR_CREATEFILE;
+	  break;
+	}
+      error = write_image (out, &cv);
+      if ((close(out) != 0) && (error == NO_ERROR)) error = ERR_WRITE;
+      printf ("frame%05d.bmp %.*s\n", frame, (int) name_length, (const char *) at);
+      at += name_length + length;
+    }
+
+  free(path);
+  free(cv.pixels);
+  munmap((void *) data, st.st_size);
+  return error;
+}
@@ -0,0 +1,87 @@
+/*idraw.h is the interface of the interpreter as a library. Compile idraw.c*/
+/*with -DIDRAW_LIBRARY to leave out main and link it into a program.*/
+/**/
+/*A context holds a scene of its own: the shapes, the canvas and its pixels.*/
+/*Different contexts can be used on different threads at the same time, but*/
+/*one context must only be used by one thread at a time.*/
+
+#ifndef IDRAW_H
+#define IDRAW_H
+
+#include <stddef.h>
+
+typedef struct idraw_context idraw_context;
+
+/*Formats of idraw_render*/
+
+#define IDRAW_PIXELS 0  /*one palette index per pixel, rows from the top*/
+#define IDRAW_BMP 1     /*the bitmap file a SAVE writes*/
+
+/*Error codes. Apart from IDRAW_OK they are the error flags of the*/
+/*interpreter, and idraw_error_message gives the message it prints.*/
+
+#define IDRAW_OK 0
+#define IDRAW_ERR_CREATEFILE 3
+#define IDRAW_ERR_HEADER 4
+#define IDRAW_ERR_POINTMAX 5
+#define IDRAW_ERR_POINT 6
+#define IDRAW_ERR_LINEMAX 7
+#define IDRAW_ERR_LINE 8
+#define IDRAW_ERR_BOXMAX 9
+#define IDRAW_ERR_BOX 10
+#define IDRAW_ERR_BOXCORNER 11
+#define IDRAW_ERR_CIRCLEMAX 12
+#define IDRAW_ERR_RADIUSMAX 13
+#define IDRAW_ERR_CENTER 14
+#define IDRAW_ERR_MOVPT 15
+#define IDRAW_ERR_MOVSHAPE 16
+#define IDRAW_ERR_MEMORY 17
+#define IDRAW_ERR_SIZE 18
+#define IDRAW_ERR_WRITE 19
+#define IDRAW_ERR_READ 20
+#define IDRAW_ERR_COMPILE 21
+#define IDRAW_ERR_OPENFILE 22
+#define IDRAW_ERR_GRAPHFILE 23
+#define IDRAW_ERR_SERIES 24
+#define IDRAW_ERR_SOCKET 25
+#define IDRAW_ERR_BUFFER 26
+
+/*idraw_create makes a context with an empty canvas of width by height*/
+/*pixels. It returns NULL when the size is out of range or memory ran out.*/
+idraw_context *idraw_create (int width, int height);
+
+/*idraw_destroy frees a context and everything it holds*/
+void idraw_destroy (idraw_context *ctx);
+
+/*idraw_set_threads sets the threads that draw the tiles of a large canvas,*/
+/*1 by default*/
+void idraw_set_threads (idraw_context *ctx, int threads);
+
+/*idraw_feed_line runs one command line, with or without its newline. SAVE*/
+/*- and SAVE fd:N fail with IDRAW_ERR_CREATEFILE, as the descriptors are*/
+/*those of the program.*/
+int idraw_feed_line (idraw_context *ctx, const char *line, size_t length);
+
+/*idraw_feed_script runs the lines of text in turn, stopping at the first*/
+/*that fails*/
+int idraw_feed_script (idraw_context *ctx, const char *text, size_t length);
+
+/*idraw_error_line gives the number of the line fed to the context that*/
+/*last failed, counting from 1, or 0 when none has*/
+int idraw_error_line (idraw_context *ctx);
+
+/*idraw_get_size gives the current size of the canvas, which SIZE changes*/
+void idraw_get_size (idraw_context *ctx, int *width, int *height);
+
+/*idraw_image_size gives the bytes idraw_render needs for format, or 0 for*/
+/*an unknown format*/
+size_t idraw_image_size (idraw_context *ctx, int format);
+
+/*idraw_render draws the scene and puts the picture in buffer, which holds*/
+/*size bytes. Only what changed since the last render or SAVE is drawn.*/
+int idraw_render (idraw_context *ctx, int format, void *buffer, size_t size);
+
+/*idraw_error_message gives the message of an error code*/
+const char *idraw_error_message (int error);
+
+#endif